@@ -0,0 +1,97 @@
+#include "record_scan.hpp"
+#include "stats_lib.hpp"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Замер приема записей на одном ядре: поиск границ записей разными
+// реализациями, определение уровня и полный путь статистики.
+// Запуск: ingest_bench [records]
+
+// Поток записей в формате журнала, как его передает SocketOutput
+string make_stream(size_t count) {
+    const char* levels[] = {"LOW", "MEDIUM", "HIGH"};
+    string stream;
+    stream.reserve(count * 64);
+    for (size_t i = 0; i < count; ++i) {
+        stream += "[2025-08-12 14:39:43] [";
+        stream += levels[i % 3];
+        stream += "] Request ";
+        stream += to_string(i % 1000);
+        stream += " served in ";
+        stream += to_string(i % 97);
+        stream += " ms\n";
+    }
+    return stream;
+}
+
+// Прием потока блоками по RECV_BUFFER_SIZE через RecordBuffer
+template <typename Callback>
+void feed(const string& stream, RecordBuffer& buffer, Callback&& callback) {
+    size_t offset = 0;
+    while (offset < stream.size()) {
+        size_t chunk = min(buffer.space_size(), stream.size() - offset);
+        memcpy(buffer.space(), stream.data() + offset, chunk);
+        buffer.commit(chunk, callback);
+        offset += chunk;
+    }
+    buffer.finish(callback);
+}
+
+void report(const char* name, size_t records, size_t bytes, Clock::duration elapsed) {
+    double seconds = chrono::duration<double>(elapsed).count();
+    cout.width(24);
+    cout << left << name << right;
+    cout.width(12);
+    cout << static_cast<size_t>(records / seconds) << " rec/s";
+    cout.width(10);
+    cout << static_cast<size_t>(bytes / seconds / (1024 * 1024)) << " MB/s\n";
+}
+
+int main(int argc, char* argv[]) {
+    const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    const string stream = make_stream(count);
+    cout << "Records: " << count << ", best scanner: "
+         << scan_impl_name(best_scan_impl()) << "\n";
+
+    // Только границы записей
+    for (ScanImpl impl : {ScanImpl::SCALAR, ScanImpl::SSE2, ScanImpl::AVX2}) {
+        auto start = Clock::now();
+        size_t records = 0;
+        const char* end = stream.data() + stream.size();
+        for (const char* pos = stream.data(); pos < end; ++pos) {
+            pos = find_byte(impl, pos, end, '\n');
+            records++;
+        }
+        string name = string("newlines (") + scan_impl_name(impl) + ")";
+        report(name.c_str(), records, stream.size(), Clock::now() - start);
+    }
+
+    // Границы и уровни через буфер приема
+    RecordBuffer buffer;
+    size_t levels[3] = {0, 0, 0};
+    auto start = Clock::now();
+    feed(stream, buffer, [&levels](string_view record) {
+        levels[static_cast<int>(scan_importance(record))]++;
+    });
+    report("records + levels", count, stream.size(), Clock::now() - start);
+    if (levels[0] + levels[1] + levels[2] != count) {
+        cerr << "Record count mismatch" << endl;
+        return 1;
+    }
+
+    // Полная статистика (шаблоны, оценки, окно последнего часа)
+    MessageStats stats;
+    time_t now = time(nullptr);
+    start = Clock::now();
+    feed(stream, buffer, [&stats, now](string_view record) {
+        update_stats(stats, record, now, "127.0.0.1:5000");
+    });
+    report("update_stats", count, stream.size(), Clock::now() - start);
+    return stats.total == count ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#include "mapped_output.hpp"
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Замер вывода в файл из одного потока (как поток записи LogManager):
+// ofstream с построчным сбросом против отображения в память.
+// Запуск: output_bench [records]
+
+void run(const char* name, unique_ptr<LogOutput> output, size_t count) {
+    const string record = "[2025-08-12 14:39:43] [MEDIUM] Request 42 served in 17 ms";
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        output->write(record);
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    output.reset(); // Закрытие не входит в замер записи
+    cout.width(10);
+    cout << left << name << right;
+    cout.width(12);
+    cout << static_cast<size_t>(count / seconds) << " rec/s";
+    cout.width(8);
+    cout << static_cast<size_t>(count * (record.size() + 1) / seconds / (1024 * 1024)) << " MB/s\n";
+}
+
+int main(int argc, char* argv[]) {
+    const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    const string filename = "output_bench.log";
+
+    filesystem::remove(filename);
+    run("ofstream", make_unique<FileOutput>(filename), count);
+    filesystem::remove(filename);
+    run("mmap", make_unique<MappedFileOutput>(filename), count);
+    filesystem::remove(filename);
+    return 0;
+}
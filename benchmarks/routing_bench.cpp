@@ -0,0 +1,125 @@
+#include "log_router.hpp"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Замер выбора маршрута: один проход автомата против перебора правил
+// с поиском каждой подстроки. Запуск: routing_bench [messages]
+
+// Словарь случайных слов - из них строятся и подстроки правил, и сообщения
+vector<string> make_words(mt19937& random, size_t count) {
+    uniform_int_distribution<int> length(3, 10);
+    uniform_int_distribution<int> letter('a', 'z');
+    vector<string> words(count);
+    for (string& word : words) {
+        int size = length(random);
+        for (int i = 0; i < size; ++i) {
+            word += static_cast<char>(letter(random));
+        }
+    }
+    return words;
+}
+
+vector<RouteRule> make_rules(mt19937& random, const vector<string>& words, size_t count) {
+    uniform_int_distribution<size_t> word(0, words.size() - 1);
+    uniform_int_distribution<int> pattern_count(1, 3);
+    uniform_int_distribution<int> level(0, 2);
+    vector<RouteRule> rules(count);
+    for (RouteRule& rule : rules) {
+        int low = level(random);
+        int high = level(random);
+        if (low > high) swap(low, high);
+        rule.min_level = static_cast<importances>(low);
+        rule.max_level = static_cast<importances>(high);
+        for (int i = pattern_count(random); i > 0; --i) {
+            rule.patterns.push_back(words[word(random)]);
+        }
+        rule.sinks = static_cast<RouteMask>(random() & 3);
+    }
+    return rules;
+}
+
+// Эталон: правила по порядку, каждая подстрока ищется отдельно
+RouteMask naive_route(const vector<RouteRule>& rules, string_view message, importances importance) {
+    for (const RouteRule& rule : rules) {
+        if (importance < rule.min_level || importance > rule.max_level) continue;
+        for (const string& pattern : rule.patterns) {
+            if (message.find(pattern) != string_view::npos) {
+                return rule.sinks;
+            }
+        }
+    }
+    return ROUTE_ALL;
+}
+
+int main(int argc, char* argv[]) {
+    const size_t message_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+    mt19937 random(42);
+    const vector<string> words = make_words(random, 5000);
+
+    // Сообщения из 6-14 слов; уровни равномерно
+    uniform_int_distribution<size_t> word(0, words.size() - 1);
+    uniform_int_distribution<int> length(6, 14);
+    vector<string> messages(message_count);
+    vector<importances> levels(message_count);
+    for (size_t i = 0; i < message_count; ++i) {
+        for (int j = length(random); j > 0; --j) {
+            messages[i] += words[word(random)];
+            messages[i] += ' ';
+        }
+        levels[i] = static_cast<importances>(i % 3);
+    }
+
+    cout << "Messages: " << message_count << "\n"
+         << "   rules   automaton ns/msg   naive ns/msg   matched\n";
+    for (size_t rule_count : {10, 100, 300, 1000}) {
+        vector<RouteRule> rules = make_rules(random, words, rule_count);
+        LogRouter router;
+        for (const RouteRule& rule : rules) {
+            router.add_rule(rule);
+        }
+        router.compile();
+
+        // Результаты обоих способов должны совпадать
+        size_t matched = 0;
+        for (size_t i = 0; i < message_count; ++i) {
+            RouteMask expected = naive_route(rules, messages[i], levels[i]);
+            if (router.route(messages[i], levels[i]) != expected) {
+                cerr << "Mismatch on message " << i << endl;
+                return 1;
+            }
+            matched += expected != ROUTE_ALL;
+        }
+
+        RouteMask sink = 0; // Не дает компилятору выбросить вызовы
+        auto start = Clock::now();
+        for (size_t i = 0; i < message_count; ++i) {
+            sink ^= router.route(messages[i], levels[i]);
+        }
+        double automaton = chrono::duration<double, nano>(Clock::now() - start).count();
+
+        start = Clock::now();
+        for (size_t i = 0; i < message_count; ++i) {
+            sink ^= naive_route(rules, messages[i], levels[i]);
+        }
+        double naive = chrono::duration<double, nano>(Clock::now() - start).count();
+
+        cout.width(8);
+        cout << rule_count;
+        cout.width(19);
+        cout << automaton / message_count;
+        cout.width(15);
+        cout << naive / message_count;
+        cout.width(10);
+        cout << matched << (sink == 1 ? " " : "") << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "sharded_output.hpp"
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Замер записи из нескольких потоков через один Journal_logger:
+// общий файл под мьютексом против сегментов по потокам.
+// Запуск: shard_bench [records_per_thread] [max_threads]
+
+// Общий файл: FileOutput не потокобезопасен, запись сериализуется
+class LockedFileOutput : public LogOutput {
+public:
+    explicit LockedFileOutput(const string& filename) : m_file(filename) {}
+    void write(const string& message) override {
+        lock_guard<mutex> lock(m_mutex);
+        m_file.write(message);
+    }
+    bool is_connected() const override { return true; }
+
+private:
+    mutex m_mutex;
+    FileOutput m_file;
+};
+
+double run(unique_ptr<LogOutput> output, size_t threads, size_t records) {
+    Journal_logger logger(move(output), importances::LOW);
+    vector<thread> producers;
+    auto start = Clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        producers.emplace_back([&logger, t, records] {
+            string message = "worker " + to_string(t) + " processed request";
+            for (size_t i = 0; i < records; ++i) {
+                logger.message_log(message, importances::MEDIUM);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    return threads * records / seconds;
+}
+
+void cleanup(const string& base) {
+    filesystem::remove(base);
+    for (const string& shard : find_journal_shards(base)) {
+        filesystem::remove(shard);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const size_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    const size_t max_threads = argc > 2 ? strtoul(argv[2], nullptr, 10) : 8;
+    const string base = "shard_bench.log";
+
+    cout << "threads      locked file/s      sharded/s\n";
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        cleanup(base);
+        double locked = run(make_unique<LockedFileOutput>(base), threads, records);
+        cleanup(base);
+        double sharded = run(make_unique<ShardedFileOutput>(base), threads, records);
+        cout.width(7);
+        cout << threads;
+        cout.width(19);
+        cout << static_cast<size_t>(locked);
+        cout.width(15);
+        cout << static_cast<size_t>(sharded) << "\n";
+    }
+    cleanup(base);
+    return 0;
+}
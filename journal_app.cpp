@@ -1,161 +1,24 @@
-#include "journal_lib.hpp"
+#include "log_manager.hpp"
+#include "shm_ring.hpp"
+#include "log_router.hpp"
+#include "mapped_output.hpp"
+#include "rotating_output.hpp"
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <cctype>
 #include <string>
-#include <thread>
-#include <mutex>
-#include <queue>
-#include <condition_variable>
-#include <atomic>
-#include <functional>
+#include <vector>
 #include <memory>
 #include <filesystem>
 #include <locale>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
-// Потокобезопасная очередь задач
-class LogQueue {
-public:
-    struct Task {
-        string message;
-        importances importance;
-    };
-
-    void push(Task task) {
-        lock_guard<mutex> lock(m_mutex);
-        m_queue.push(move(task));
-        m_condition.notify_one();
-    }
-
-    // Извлечение задачи (блокировка)
-    bool pop(Task& task) {
-        unique_lock<mutex> lock(m_mutex);
-        // Ждем пока не появится задача или не придет сигнал остановки
-        m_condition.wait(lock, [this]() { return !m_queue.empty() || m_stop; });
-        
-        if (m_stop && m_queue.empty()) {
-            return false;
-        }
-        
-        task = move(m_queue.front());
-        m_queue.pop();
-        return true;
-    }
-
-    void shutdown() {
-        m_stop = true;
-        m_condition.notify_all();
-    }
-
-private:
-    queue<Task> m_queue;
-    mutex m_mutex;
-    condition_variable m_condition;
-    atomic<bool> m_stop{false};
-};
-
-// Базовый абстрактный класс для логгеров (файлового и сокетного). Расширяет функционал Journal_logger
-class ILogger {
-public:
-    virtual ~ILogger() = default;
-    virtual void log(const string& message, importances importance) = 0;
-    virtual importances get_default_importance() const = 0;
-};
-
-// Реализация логгера для работы с файлом
-class FileLogger : public ILogger {
-public:
-    FileLogger(const string& filename, importances default_level)
-        : logger(filename, default_level) {}
-
-    void log(const string& message, importances importance) override {
-        logger.message_log(message, importance);
-    }
-
-    importances get_default_importance() const override {
-        return logger.get_default_importance();
-    }
-
-private:
-    Journal_logger logger; // Композиция
-};
-
-// Комбинированный логгер (сокет + файл)
-class SocketFileLogger : public ILogger {
-public:
-    SocketFileLogger(const string& host, int port, 
-                   const string& filename, importances default_level)
-        : socket_logger(host, port, default_level),
-          file_logger(filename, default_level) {}
-
-    void log(const string& message, importances importance) override {
-        try {
-            socket_logger.message_log(message, importance);
-        } catch (const runtime_error& e) {
-            cerr << "Socket error: " << e.what() << endl;
-            cerr << "Message saved to file only" << endl;
-        }
-        file_logger.message_log(message, importance); // Всегда пишем в файл
-    }
-
-    importances get_default_importance() const override {
-        return file_logger.get_default_importance(); // Используем уровень из file_logger
-    }
-
-private:
-    Journal_logger socket_logger;
-    Journal_logger file_logger;
-};
-
-// Менеджер логгирования
-class LogManager {
-public:
-    LogManager(unique_ptr<ILogger> logger) : m_logger(move(logger)) {}
-    
-    ~LogManager() {
-        stop();
-    }
-
-    void start() {
-        m_worker = thread(&LogManager::process_tasks, this);
-    }
-
-    void stop() {
-        if (m_running) {
-            m_running = false;
-            m_queue.shutdown();
-            if (m_worker.joinable()) {
-                m_worker.join();
-            }
-        }
-    }
-
-    // Добавление сообщения в очередь обработки
-    void log(const string& message, importances importance) {
-        m_queue.push({message, importance});
-    }
-
-    ILogger& get_logger() { return *m_logger; }
-
-private:
-    // Основной цикл обработки задач
-    void process_tasks() {
-        LogQueue::Task task;
-        while (m_running) {
-            if (m_queue.pop(task)) {
-                m_logger->log(task.message, task.importance);
-            }
-        }
-    }
-
-    unique_ptr<ILogger> m_logger;
-    LogQueue m_queue;
-    thread m_worker;
-    atomic<bool> m_running{true};
-};
-
 // Обработчик ввода
 class InputHandler {
 public:
@@ -228,8 +91,22 @@ private:
 
 void print_usage() {
     cout << "Usage:\n"
-         << "  File mode: journal_app <filename> [default_importance]\n"
-         << "  Socket mode: journal_app --socket <host> <port> <filename> [default_importance]\n";
+         << "  File mode: journal_app [options] <filename> [default_importance]\n"
+         << "  Socket mode: journal_app [options] --socket <host> <port> <filename> [default_importance]\n"
+         << "  Shared memory mode: journal_app [options] --shm <name> <filename> [default_importance]\n"
+         << "Options (batch mode is non-interactive, one message per line, optional [LEVEL] prefix):\n"
+         << "  --batch            read messages from stdin\n"
+         << "  --input <file>     read messages from file (implies --batch)\n"
+         << "  --workers <n>      number of formatting threads (default 1)\n"
+         << "  --routes <file>    routing rules (sinks: file, socket or shm, plus declared files)\n"
+         << "  --priority <p>     queue lanes policy: fifo (default), strict or weighted\n"
+         << "  --memory-budget <bytes>  queue memory limit; overflow goes to <filename>.spill\n"
+         << "  --mmap             write journal files through preallocated memory-mapped segments\n"
+         << "                     (not for live tailing: tail -F and stats_collector --follow\n"
+         << "                     get no change events and see a zero-filled tail)\n"
+         << "  --rotate-size <bytes>    rotate journal files when they reach this size\n"
+         << "  --rotate-age <seconds>   rotate journal files older than this\n"
+         << "  --keep <n>         rotated files to keep, compressed to .gz (default 7, 0 - all)\n";
 }
 
 // Функция для получения абсолютного пути к файлу в папке проекта.
@@ -253,14 +130,78 @@ int main(int argc, char* argv[]) {
     setlocale(LC_ALL, "ru_RU.UTF-8"); // Для поддержки русского ввода.
                                       // Сообщения принимаются (распознаются) и на русском 
                                       // и на английском
+    // Дополнительные параметры идут перед основными аргументами
+    bool batch_mode = false;
+    string input_file;
+    size_t format_workers = 1;
+    string routes_file;
+    LaneOptions lane_options;
+    size_t memory_budget = 0;
+    bool mapped_files = false;
+    RotationPolicy rotation;
+    while (argc > 1) {
+        string option = argv[1];
+        if (option == "--batch") {
+            batch_mode = true;
+        } else if (option == "--mmap") {
+            mapped_files = true;
+        } else if (option == "--input" && argc > 2) {
+            batch_mode = true;
+            input_file = argv[2];
+            --argc;
+            ++argv;
+        } else if (option == "--routes" && argc > 2) {
+            routes_file = argv[2];
+            --argc;
+            ++argv;
+        } else if (option == "--priority" && argc > 2) {
+            string policy = argv[2];
+            if (policy == "fifo") lane_options.policy = LanePolicy::FIFO;
+            else if (policy == "strict") lane_options.policy = LanePolicy::STRICT;
+            else if (policy == "weighted") lane_options.policy = LanePolicy::WEIGHTED;
+            else {
+                print_usage();
+                return 1;
+            }
+            --argc;
+            ++argv;
+        } else if (option == "--memory-budget" && argc > 2) {
+            memory_budget = strtoull(argv[2], nullptr, 10);
+            --argc;
+            ++argv;
+        } else if (option == "--rotate-size" && argc > 2) {
+            rotation.max_bytes = strtoull(argv[2], nullptr, 10);
+            --argc;
+            ++argv;
+        } else if (option == "--rotate-age" && argc > 2) {
+            rotation.max_age = chrono::seconds(strtoull(argv[2], nullptr, 10));
+            --argc;
+            ++argv;
+        } else if (option == "--keep" && argc > 2) {
+            rotation.retention = strtoul(argv[2], nullptr, 10);
+            --argc;
+            ++argv;
+        } else if (option == "--workers" && argc > 2) {
+            format_workers = strtoul(argv[2], nullptr, 10);
+            --argc;
+            ++argv;
+        } else {
+            break;
+        }
+        --argc;
+        ++argv;
+    }
+
     if (argc < 2) {
         print_usage();
         return 1;
     }
 
     try {
-        unique_ptr<ILogger> logger;
         importances default_level = importances::MEDIUM;
+        string filename;                // Файл журнала
+        unique_ptr<LogOutput> remote;   // Сокет или общая память (если заданы)
+        string remote_name;             // Имя удаленного вывода в файле маршрутов
 
         // Режим сокета + файла
         if (string(argv[1]) == "--socket") {
@@ -271,7 +212,7 @@ int main(int argc, char* argv[]) {
 
             string host = argv[2];
             int port = stoi(argv[3]);
-            string filename = get_project_file_path(argv[4]).string();
+            filename = get_project_file_path(argv[4]).string();
 
             if (argc > 5) {
                 string level_str = argv[5];
@@ -280,11 +221,32 @@ int main(int argc, char* argv[]) {
                 else if (level_str == "HIGH") default_level = importances::HIGH;
             }
 
-            logger = make_unique<SocketFileLogger>(host, port, filename, default_level);
+            remote = make_unique<SocketOutput>(host, port);
+            remote_name = "socket";
         } 
+        // Режим общей памяти + файла (коллектор на том же хосте)
+        else if (string(argv[1]) == "--shm") {
+            if (argc < 4) {
+                cerr << "Error: Shared memory mode requires segment name and filename\n";
+                return 1;
+            }
+
+            string name = argv[2];
+            filename = get_project_file_path(argv[3]).string();
+
+            if (argc > 4) {
+                string level_str = argv[4];
+                if (level_str == "LOW") default_level = importances::LOW;
+                else if (level_str == "MEDIUM") default_level = importances::MEDIUM;
+                else if (level_str == "HIGH") default_level = importances::HIGH;
+            }
+
+            remote = make_unique<ShmRingOutput>(name);
+            remote_name = "shm";
+        }
         // Файловый режим
         else {
-            string filename = get_project_file_path(argv[1]).string();
+            filename = get_project_file_path(argv[1]).string();
 
             if (argc > 2) {
                 string level_str = argv[2];
@@ -292,15 +254,84 @@ int main(int argc, char* argv[]) {
                 else if (level_str == "MEDIUM") default_level = importances::MEDIUM;
                 else if (level_str == "HIGH") default_level = importances::HIGH;
             }
+        }
 
-            logger = make_unique<FileLogger>(filename, default_level);
+        // Вывод в файл журнала: с ротацией, поток ofstream или отображение в память
+        auto make_file_output = [mapped_files, rotation](const string& path) -> unique_ptr<LogOutput> {
+            if (rotation.max_bytes > 0 || rotation.max_age.count() > 0) {
+                return make_unique<RotatingFileOutput>(path, rotation);
+            }
+            if (mapped_files) {
+                return make_unique<MappedFileOutput>(path);
+            }
+            return make_unique<FileOutput>(path);
+        };
+
+        unique_ptr<ILogger> logger;
+        if (!routes_file.empty()) {
+            // Маршрутизация по правилам: основной файл, удаленный вывод
+            // и файлы, объявленные в правилах
+            vector<RoutingLogger::Sink> sinks;
+            sinks.push_back({"file", make_unique<Journal_logger>(make_file_output(filename), default_level)});
+            if (remote) {
+                sinks.push_back({remote_name, make_unique<Journal_logger>(move(remote), default_level)});
+            }
+            vector<string> names;
+            for (const RoutingLogger::Sink& sink : sinks) {
+                names.push_back(sink.name);
+            }
+
+            ifstream routes(routes_file);
+            if (!routes) {
+                throw runtime_error("Cannot open routes file " + routes_file);
+            }
+            RouteConfig config = parse_route_config(routes, names);
+            for (const auto& [name, file] : config.file_sinks) {
+                sinks.push_back({name, make_unique<Journal_logger>(
+                    make_file_output(get_project_file_path(file).string()), default_level)});
+            }
+            logger = make_unique<RoutingLogger>(move(sinks), move(config.router));
+        } else if (remote) {
+            logger = make_unique<SocketFileLogger>(move(remote), make_file_output(filename), 
+                                                   default_level);
+        } else {
+            logger = make_unique<FileLogger>(make_file_output(filename), default_level);
         }
 
         // Инициализация и запуск системы логирования
-        LogManager log_manager(move(logger));
+        LogManager log_manager(move(logger), format_workers);
+        log_manager.set_lane_options(lane_options);
+        if (memory_budget > 0) {
+            log_manager.set_memory_budget(memory_budget, filename + ".spill");
+        }
         log_manager.start();
 
-        {
+        if (batch_mode) {
+            // Пакетный режим: без приглашений, чтение большими блоками
+            int fd = STDIN_FILENO;
+            if (!input_file.empty()) {
+                fd = open(input_file.c_str(), O_RDONLY);
+                if (fd == -1) {
+                    throw runtime_error("Cannot open input file " + input_file + 
+                                        ": " + strerror(errno));
+                }
+            }
+            size_t count;
+            try {
+                count = ingest_batch(fd, log_manager, default_level);
+            } catch (...) {
+                if (fd != STDIN_FILENO) {
+                    close(fd);
+                }
+                // Уже принятые записи дописываются до выхода с ошибкой
+                log_manager.stop();
+                throw;
+            }
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            cerr << "Batch: " << count << " messages queued" << endl;
+        } else {
             InputHandler input(log_manager);
             input.run(); // Ввод
         }
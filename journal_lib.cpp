@@ -1,4 +1,5 @@
 #include "journal_lib.hpp"
+#include "journal_probes.hpp"
 #include <stdexcept>
 #include <iomanip>
 #include <sstream>
@@ -6,9 +7,36 @@
 #include <cerrno>
 #include <unistd.h>
 #include <filesystem>
+#include <algorithm>
+#include <sys/uio.h>
+#include <charconv>
+#include <fcntl.h>
 
 using namespace std;
 
+// Источник записей
+namespace {
+
+atomic<uint32_t> g_next_producer{1};
+thread_local uint32_t t_own_producer = 0;
+thread_local uint32_t t_producer_override = 0;
+
+} // namespace
+
+uint32_t current_log_producer() {
+    if (t_producer_override != 0) {
+        return t_producer_override;
+    }
+    if (t_own_producer == 0) {
+        t_own_producer = g_next_producer++;
+    }
+    return t_own_producer;
+}
+
+void set_log_producer(uint32_t producer) {
+    t_producer_override = producer;
+}
+
 // FileOutput
 FileOutput::FileOutput(const string& filename) 
     : filename(filename) {
@@ -31,12 +59,16 @@ FileOutput::~FileOutput() {
     if (log_file.is_open()) {
         log_file.close();
     }
+    if (sync_fd != -1) {
+        close(sync_fd);
+    }
 }
 
 void FileOutput::write(const string& message) {
     if (!log_file.is_open()) {
         reopen(); // Попытка восстановить соединение
     }
+    JOURNAL_PROBE(file__write, message.size());
     log_file << message << endl;
 }
 
@@ -44,6 +76,21 @@ bool FileOutput::is_connected() const {
     return log_file.is_open();
 }
 
+void FileOutput::sync() {
+    log_file.flush();
+    // ofstream не дает свой дескриптор; fsync через любой дескриптор
+    // файла сбрасывает все его данные
+    if (sync_fd == -1) {
+        sync_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (sync_fd == -1) {
+            throw runtime_error("Cannot open file for sync: " + filename);
+        }
+    }
+    if (fsync(sync_fd) == -1) {
+        throw runtime_error("fsync failed: " + string(strerror(errno)));
+    }
+}
+
 void FileOutput::reopen() {
     log_file.open(filename, ios::app);
     if (!log_file.is_open()) {
@@ -63,6 +110,7 @@ SocketOutput::~SocketOutput() {
 
 void SocketOutput::write(const string& message) {
     if (message.empty()) return;
+    JOURNAL_PROBE(socket__write, message.size());
     if (sockfd == -1) {
         try {
             connect();
@@ -71,10 +119,37 @@ void SocketOutput::write(const string& message) {
         }
     }
 
-    int result = send(sockfd, message.c_str(), message.size(), 0);
-    if (result == -1) {
-        disconnect(); // Закрываем нерабочее соединение
-        throw runtime_error("Socket send failed: " + string(strerror(errno)));
+    // Запись завершается переводом строки, чтобы получатель мог
+    // разделить поток на записи. Отправляется одним вызовом
+    char newline = '\n';
+    iovec parts[2] = {
+        {const_cast<char*>(message.data()), message.size()},
+        {&newline, 1}
+    };
+    msghdr msg{};
+    msg.msg_iov = parts;
+    msg.msg_iovlen = 2;
+
+    size_t remaining = message.size() + 1;
+    while (remaining > 0) {
+        ssize_t result = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            disconnect(); // Закрываем нерабочее соединение
+            throw runtime_error("Socket send failed: " + string(strerror(errno)));
+        }
+        // Частичная отправка: сдвигаемся на отправленные байты
+        remaining -= result;
+        while (result > 0 && msg.msg_iovlen > 0) {
+            size_t chunk = min<size_t>(result, msg.msg_iov->iov_len);
+            msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + chunk;
+            msg.msg_iov->iov_len -= chunk;
+            result -= chunk;
+            if (msg.msg_iov->iov_len == 0) {
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+        }
     }
 }
 
@@ -116,35 +191,75 @@ Journal_logger::Journal_logger(const string& host, int port, importances importa
     : output(make_unique<SocketOutput>(host, port)),
       default_importance(importance) {}
 
+Journal_logger::Journal_logger(unique_ptr<LogOutput> output, importances importance)
+    : output(move(output)),
+      default_importance(importance) {}
+
 void Journal_logger::message_log(const string& message, importances importance) {
-    if (importance < default_importance) return;
+    message_log(message, importance, {});
+}
+
+void Journal_logger::message_log(const string& message, importances importance,
+                                 initializer_list<LogField> fields) {
+    // Форматирование и запись
+    string formatted;
+    if (prepare_record(message, importance, time(nullptr), formatted, fields)) {
+        output->write(formatted);
+    }
+}
+
+bool Journal_logger::prepare_record(const string& message, importances importance,
+                                    time_t timestamp, string& out,
+                                    initializer_list<LogField> fields) const {
+    if (importance < default_importance) return false;
     if (message.empty()) {
         throw invalid_argument("Message cannot be empty");
     }
-    
-    // Форматирование и запись
-    time_t now = time(nullptr);
-    string formatted = format_log(message, importance, now);
-    output->write(formatted);
+    out.clear();
+    format_log(out, message, importance, timestamp, fields);
+    return true;
+}
+
+bool Journal_logger::prepare_record(const string& message, importances importance,
+                                    time_t timestamp, string& out,
+                                    string_view encoded_fields) const {
+    if (!prepare_record(message, importance, timestamp, out)) {
+        return false;
+    }
+    out.append(encoded_fields);
+    return true;
+}
+
+void Journal_logger::write_record(const string& record) {
+    output->write(record);
+}
+
+void Journal_logger::sync() {
+    output->sync();
 }
 
 void Journal_logger::set_default_importance(importances new_importance) {
     default_importance = new_importance;
 }
 
-string Journal_logger::format_log(
+void Journal_logger::format_log(
+    string& out,
     const string& message, 
     importances importance, 
-    time_t timestamp
+    time_t timestamp,
+    initializer_list<LogField> fields
 ) const {
+    JOURNAL_PROBE(format__entry, message.size(), static_cast<int>(importance),
+                  static_cast<int64_t>(timestamp));
+    [[maybe_unused]] const size_t start = out.size();
+
     // Форматирование временной метки
     char time_buf[64];
     tm time_info;
     if (localtime_r(&timestamp, &time_info) == nullptr) {
         throw runtime_error("Failed to convert time");
     }
-    localtime_r(&timestamp, &time_info);
-    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &time_info);
+    size_t time_len = strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &time_info);
 
     // Преобразование уровня важности в строку
     const char* importance_str = "";
@@ -154,5 +269,65 @@ string Journal_logger::format_log(
         case importances::HIGH:   importance_str = "HIGH";   break;
     }
 
-    return "[" + string(time_buf) + "] [" + importance_str + "] " + message;
-}
\ No newline at end of file
+    // Собираем запись в одной строке без промежуточных копий
+    out.reserve(out.size() + time_len + message.size() + 16 + fields.size() * 32);
+    out += '[';
+    out.append(time_buf, time_len);
+    out += "] [";
+    out += importance_str;
+    out += "] ";
+    // Разделитель и переводы строк в тексте заменяются пробелом: иначе хвост
+    // сообщения читался бы как поле или как отдельная запись (в файле и в
+    // потоке сокета записи разделяются переводом строки)
+    static const char special[] = {LOG_FIELD_SEPARATOR, '\n', '\r', '\0'};
+    if (message.find_first_of(special) == string::npos) {
+        out += message;
+    } else {
+        for (char c : message) {
+            out += (c == LOG_FIELD_SEPARATOR || c == '\n' || c == '\r') ? ' ' : c;
+        }
+    }
+    for (const LogField& field : fields) {
+        append_log_field(out, field);
+    }
+    JOURNAL_PROBE(format__exit, out.size() - start);
+}
+
+// Структурированные поля
+namespace {
+
+// Копирует текст, заменяя символы, ломающие разметку записи
+void append_sanitized(string& out, string_view text) {
+    for (char c : text) {
+        out += (c == LOG_FIELD_SEPARATOR || c == '\n' || c == '\r' || c == '=') ? ' ' : c;
+    }
+}
+
+} // namespace
+
+void append_log_field(string& out, const LogField& field) {
+    out += LOG_FIELD_SEPARATOR;
+    out += static_cast<char>(field.type);
+    append_sanitized(out, field.key);
+    out += '=';
+
+    char num_buf[32];
+    switch (field.type) {
+        case LogField::Type::INT: {
+            auto res = to_chars(num_buf, num_buf + sizeof(num_buf), field.int_value);
+            out.append(num_buf, res.ptr);
+            break;
+        }
+        case LogField::Type::DOUBLE: {
+            auto res = to_chars(num_buf, num_buf + sizeof(num_buf), field.double_value);
+            out.append(num_buf, res.ptr);
+            break;
+        }
+        case LogField::Type::STRING:
+            // '=' в значении допустим: ключ заканчивается на первом '='
+            for (char c : field.string_value) {
+                out += (c == LOG_FIELD_SEPARATOR || c == '\n' || c == '\r') ? ' ' : c;
+            }
+            break;
+    }
+}
@@ -3,6 +3,11 @@
 #include <ctime>
 #include <fstream>
 #include <memory>
+#include <string_view>
+#include <initializer_list>
+#include <type_traits>
+#include <atomic>
+#include <cstdint>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -11,12 +16,95 @@
 
 enum class importances { LOW, MEDIUM, HIGH }; // Уровни важности сообщений
 
+// Разделитель структурированных полей в записи лога (ASCII Unit Separator).
+// Поля дописываются после текста сообщения в виде
+//   <US><тип><ключ>=<значение>
+// где тип: 'i' - целое, 'd' - вещественное, 's' - строка.
+// Символ не встречается в обычном тексте, поэтому получатель отделяет
+// поля без разбора самого сообщения.
+constexpr char LOG_FIELD_SEPARATOR = '\x1F';
+
+// Типизированное поле структурированной записи (ключ/значение).
+// Хранит только ссылки на ключ и строковое значение - они должны
+// жить до окончания вызова message_log
+struct LogField {
+    enum class Type : char { INT = 'i', DOUBLE = 'd', STRING = 's' };
+
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    LogField(std::string_view key, T value)
+        : key(key), type(Type::INT), int_value(static_cast<long long>(value)) {}
+    LogField(std::string_view key, double value)
+        : key(key), type(Type::DOUBLE), double_value(value) {}
+    LogField(std::string_view key, std::string_view value)
+        : key(key), type(Type::STRING), string_value(value) {}
+    LogField(std::string_view key, const char* value)
+        : LogField(key, std::string_view(value)) {}
+    LogField(std::string_view key, const std::string& value)
+        : LogField(key, std::string_view(value)) {}
+
+    std::string_view key;
+    Type type;
+    long long int_value = 0;
+    double double_value = 0.0;
+    std::string_view string_value;
+};
+
+// Поле, выделенное из уже закодированной записи (без копирования)
+struct ParsedLogField {
+    std::string_view key;
+    LogField::Type type;
+    std::string_view value;
+};
+
+// Дописывает закодированное поле в конец записи. Разделитель и переводы
+// строки в ключе и значении заменяются пробелом
+void append_log_field(std::string& out, const LogField& field);
+
+// Отделяет текст сообщения от структурированных полей.
+// Возвращает текст, поля передаются в callback по порядку
+template <typename Callback>
+std::string_view for_each_log_field(std::string_view record, Callback&& callback) {
+    size_t pos = record.find(LOG_FIELD_SEPARATOR);
+    std::string_view text = record.substr(0, pos);
+    while (pos != std::string_view::npos) {
+        size_t next = record.find(LOG_FIELD_SEPARATOR, pos + 1);
+        std::string_view item = record.substr(pos + 1, next == std::string_view::npos 
+                                                       ? std::string_view::npos 
+                                                       : next - pos - 1);
+        size_t eq = item.find('=');
+        if (item.size() >= 2 && eq != std::string_view::npos && eq > 1) {
+            char type = item[0];
+            if (type == 'i' || type == 'd' || type == 's') {
+                callback(ParsedLogField{
+                    item.substr(1, eq - 1),
+                    static_cast<LogField::Type>(type),
+                    item.substr(eq + 1)
+                });
+            }
+        }
+        pos = next;
+    }
+    return text;
+}
+
+// Номер источника записей (потока, создавшего запись), начиная с 1.
+// По умолчанию - номер вызывающего потока. LogManager выводит записи из
+// своего потока и на время вывода подставляет номер потока, вызвавшего
+// log, поэтому выводы, разделяющие записи по источникам
+// (ShardedFileOutput), видят настоящего источника
+uint32_t current_log_producer();
+// Подстановка источника для записей, выводимых текущим потоком (0 - отмена)
+void set_log_producer(uint32_t producer);
+
 // Базовый интерфейс для вывода логов
 class LogOutput {
 public:
     virtual ~LogOutput() = default;
     virtual void write(const std::string& message) = 0; // Запись сообщения
     virtual bool is_connected() const = 0; // Проверка подключения
+    // Сброс записанного на устройство (для гарантии сохранности).
+    // По умолчанию ничего не делает: вывод не буферизует данные
+    virtual void sync() {}
 };
 
 // Реализация вывода в файл
@@ -26,10 +114,12 @@ public:
     ~FileOutput() override;
     void write(const std::string& message) override;
     bool is_connected() const override;
+    void sync() override; // flush и fsync
 
 private:
     std::string filename;
     std::ofstream log_file;
+    int sync_fd = -1; // Дескриптор файла для fsync (открывается при первом sync)
     void reopen(); // Переоткрытие файла при ошибках
 };
 
@@ -56,6 +146,8 @@ public:
     Journal_logger(const std::string& filename, importances importance); 
     // Конструктор для сокетного режима
     Journal_logger(const std::string& host, int port, importances importance); 
+    // Конструктор с произвольным выводом
+    Journal_logger(std::unique_ptr<LogOutput> output, importances importance);
     
     ~Journal_logger() = default;
 
@@ -64,19 +156,48 @@ public:
     Journal_logger& operator=(const Journal_logger&) = delete;
 
     void message_log(const std::string& message, importances importance);
+    // Запись с типизированными полями ключ/значение
+    void message_log(const std::string& message, importances importance,
+                     std::initializer_list<LogField> fields);
     void set_default_importance(importances new_importance);
     importances get_default_importance() const {
         return default_importance;
     }
 
+    // Подготовка записи без вывода. Возвращает false, если сообщение ниже
+    // уровня по умолчанию. Не меняет состояние логгера, поэтому может
+    // вызываться параллельно из нескольких потоков
+    bool prepare_record(
+        const std::string& message,
+        importances importance,
+        time_t timestamp,
+        std::string& out,
+        std::initializer_list<LogField> fields = {}
+    ) const;
+    // То же с полями, уже закодированными append_log_field (LogManager
+    // кодирует поля при вызове log, форматирование идет позже)
+    bool prepare_record(
+        const std::string& message,
+        importances importance,
+        time_t timestamp,
+        std::string& out,
+        std::string_view encoded_fields
+    ) const;
+    // Вывод подготовленной записи
+    void write_record(const std::string& record);
+    // Сброс вывода на устройство
+    void sync();
+
 private:
     std::unique_ptr<LogOutput> output;
-    importances default_importance;
+    std::atomic<importances> default_importance;
 
-    // Форматирование записи лога
-    std::string format_log(
+    // Форматирование записи лога (дописывается в out, емкость out переиспользуется)
+    void format_log(
+        std::string& out,
         const std::string& message, 
         importances importance, 
-        time_t timestamp
+        time_t timestamp,
+        std::initializer_list<LogField> fields = {}
     ) const;
 };
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "sharded_output.hpp"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Сборка журнала из сегментов потоков (ShardedFileOutput).
+// Сегменты читаются последовательно и сливаются по времени записи,
+// в памяти держится по одной строке на сегмент
+void print_usage() {
+    cout << "Usage: journal_merge <output_file> <base>\n"
+         << "       journal_merge <output_file> <shard> <shard>...\n"
+         << "  <base>   merges <base>.shard-0, <base>.shard-1, ...\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    const string output = argv[1];
+    vector<string> shards;
+    if (argc == 3 && !filesystem::is_regular_file(argv[2])) {
+        shards = find_journal_shards(argv[2]);
+        if (shards.empty()) {
+            cerr << "No shards found for " << argv[2] << endl;
+            return 1;
+        }
+    } else {
+        shards.assign(argv + 2, argv + argc);
+    }
+
+    try {
+        // Как у FileOutput: BOM в начале нового файла
+        bool is_new = !filesystem::exists(output) || filesystem::file_size(output) == 0;
+        vector<char> buffer(1 << 20);
+        ofstream out;
+        out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        out.open(output, ios::app | ios::binary);
+        if (!out) {
+            cerr << "Cannot open output file: " << output << endl;
+            return 1;
+        }
+        if (is_new) {
+            out << "\xEF\xBB\xBF";
+        }
+
+        size_t count = merge_journal_shards(shards, out);
+        out.flush();
+        if (!out) {
+            cerr << "Write error: " << output << endl;
+            return 1;
+        }
+        cout << "Merged " << count << " records from " << shards.size()
+             << " shards into " << output << endl;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
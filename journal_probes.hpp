@@ -0,0 +1,27 @@
+#pragma once
+
+// Статические точки трассировки USDT (провайдер "journal") для perf,
+// bpftrace и SystemTap. Включаются опцией ENABLE_USDT при наличии
+// <sys/sdt.h> (пакет systemtap-sdt-dev): точка - одна инструкция nop и
+// описание в секции .note.stapsdt, без трассировки ничего не стоит.
+// Без опции макрос пуст, аргументы не вычисляются.
+//
+// Точки и аргументы:
+//   log__enqueue   (arrival, size, level, timestamp) - LogQueue, постановка
+//   log__dequeue   (arrival, sequence, size, level)  - поток форматирования
+//   format__entry  (size, level, timestamp)          - начало format_log
+//   format__exit   (record_size)                     - конец format_log
+//   file__write    (size)                            - FileOutput::write
+//   socket__write  (size)                            - SocketOutput::write
+//   stats__update  (size, level, timestamp)          - update_stats
+//
+// Задержка в очереди по номеру поступления:
+//   bpftrace -e 'usdt:./journal_app:journal:log__enqueue { @t[arg0] = nsecs; }
+//                usdt:./journal_app:journal:log__dequeue /@t[arg0]/ {
+//                    @queue_ns = hist(nsecs - @t[arg0]); delete(@t[arg0]); }'
+#if defined(JOURNAL_USDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define JOURNAL_PROBE(name, ...) STAP_PROBEV(journal, name, __VA_ARGS__)
+#else
+#define JOURNAL_PROBE(name, ...) do {} while (0)
+#endif
@@ -0,0 +1,236 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Отставание от расписания, после которого сообщение считается опоздавшим
+constexpr auto LATE_THRESHOLD = chrono::milliseconds(10);
+// Размер пачки записей, отправляемой одним вызовом send
+constexpr size_t SEND_CHUNK_SIZE = 64 * 1024;
+
+// Параметры воспроизведения
+struct ReplayOptions {
+    string journal;
+    string host;
+    int port = 0;
+    double rate = 0.0;      // Сообщений в секунду суммарно (0 - без ограничения)
+    size_t connections = 1; // Число параллельных соединений
+    size_t loops = 1;       // Сколько раз проигрывать журнал
+};
+
+// Результаты одного соединения
+struct ReplayCounters {
+    atomic<size_t> sent{0};
+    atomic<size_t> dropped{0};
+    atomic<size_t> late{0};
+    atomic<size_t> bytes{0};
+};
+
+void print_usage() {
+    cout << "Usage: journal_replay <journal_file> <host> <port> [options]\n"
+         << "Options:\n"
+         << "  --rate <msg/s>       total send rate (default 0 - as fast as possible)\n"
+         << "  --connections <n>    parallel connections (default 1)\n"
+         << "  --loops <n>          replay the journal n times (default 1)\n";
+}
+
+// Загрузка журнала: строки хранятся в одном буфере, записи ссылаются на него
+vector<string_view> load_journal(const string& filename, string& storage) {
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("Cannot open journal: " + filename);
+    }
+    ostringstream content;
+    content << file.rdbuf();
+    storage = content.str();
+
+    // Пропускаем UTF-8 BOM, который FileOutput пишет в начало журнала
+    size_t pos = 0;
+    if (storage.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        pos = 3;
+    }
+
+    vector<string_view> lines;
+    string_view data(storage);
+    while (pos < data.size()) {
+        size_t end = data.find('\n', pos);
+        if (end == string_view::npos) end = data.size();
+        string_view line = data.substr(pos, end - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (!line.empty()) lines.push_back(line);
+        pos = end + 1;
+    }
+    return lines;
+}
+
+int connect_to(const string& host, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == -1) return -1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        connect(sock, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool send_all(int sock, const string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t result = send(sock, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += result;
+    }
+    return true;
+}
+
+// Воспроизведение доли журнала одним соединением: записи index, для
+// которых index % connections == id. Записи, чье время по расписанию
+// уже наступило, отправляются одной пачкой
+void replay_connection(const ReplayOptions& options, const vector<string_view>& lines,
+                       size_t id, Clock::time_point start, ReplayCounters& counters) {
+    size_t share = 0;
+    for (size_t i = id; i < lines.size(); i += options.connections) share++;
+    const size_t total = share * options.loops;
+    if (total == 0) return;
+
+    int sock = connect_to(options.host, options.port);
+    if (sock == -1) {
+        counters.dropped += total;
+        return;
+    }
+
+    // Интервал между сообщениями одного соединения
+    const bool paced = options.rate > 0.0;
+    const chrono::duration<double> interval(paced ? options.connections / options.rate : 0.0);
+
+    string chunk;
+    chunk.reserve(SEND_CHUNK_SIZE + 4096);
+    size_t sent = 0;
+    size_t index = id;
+
+    while (sent < total) {
+        if (paced) {
+            auto scheduled = start + chrono::duration_cast<Clock::duration>(interval * sent);
+            auto now = Clock::now();
+            if (now < scheduled) {
+                this_thread::sleep_until(scheduled);
+                now = Clock::now();
+            }
+            // Набираем все сообщения, время которых уже наступило
+            size_t batch = 0;
+            while (sent + batch < total && chunk.size() < SEND_CHUNK_SIZE) {
+                auto due = start + chrono::duration_cast<Clock::duration>(interval * (sent + batch));
+                if (due > now) break;
+                if (now - due > LATE_THRESHOLD) counters.late++;
+                chunk.append(lines[index].data(), lines[index].size());
+                chunk += '\n';
+                batch++;
+                index += options.connections;
+                if (index >= lines.size()) index = id;
+            }
+            if (!send_all(sock, chunk)) break;
+            sent += batch;
+        } else {
+            size_t batch = 0;
+            while (sent + batch < total && chunk.size() < SEND_CHUNK_SIZE) {
+                chunk.append(lines[index].data(), lines[index].size());
+                chunk += '\n';
+                batch++;
+                index += options.connections;
+                if (index >= lines.size()) index = id;
+            }
+            if (!send_all(sock, chunk)) break;
+            sent += batch;
+        }
+        counters.bytes += chunk.size();
+        chunk.clear();
+    }
+
+    counters.sent += sent;
+    counters.dropped += total - sent;
+    close(sock);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        print_usage();
+        return 1;
+    }
+
+    ReplayOptions options;
+    try {
+        options.journal = argv[1];
+        options.host = argv[2];
+        options.port = stoi(argv[3]);
+        for (int i = 4; i < argc; ++i) {
+            string arg = argv[i];
+            if (i + 1 >= argc) throw invalid_argument("Missing value for " + arg);
+            if (arg == "--rate") options.rate = stod(argv[++i]);
+            else if (arg == "--connections") options.connections = stoul(argv[++i]);
+            else if (arg == "--loops") options.loops = stoul(argv[++i]);
+            else throw invalid_argument("Unknown option " + arg);
+        }
+        if (options.connections == 0) throw invalid_argument("Need at least one connection");
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        print_usage();
+        return 1;
+    }
+
+    string storage;
+    vector<string_view> lines;
+    try {
+        lines = load_journal(options.journal, storage);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    if (lines.empty()) {
+        cerr << "Error: journal is empty" << endl;
+        return 1;
+    }
+
+    ReplayCounters counters;
+    auto start = Clock::now();
+    vector<thread> workers;
+    for (size_t id = 0; id < options.connections; ++id) {
+        workers.emplace_back(replay_connection, cref(options), cref(lines), id, start, ref(counters));
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << "=== Replay ===\n"
+         << "Connections: " << options.connections << "\n"
+         << "Sent:    " << counters.sent << "\n"
+         << "Dropped: " << counters.dropped << "\n"
+         << "Late:    " << counters.late << " (more than " << LATE_THRESHOLD.count() << " ms behind)\n"
+         << "Elapsed: " << elapsed << " s\n"
+         << "Throughput: " << (elapsed > 0 ? counters.sent / elapsed : 0.0) << " msg/s, "
+         << (elapsed > 0 ? counters.bytes / elapsed / (1024 * 1024) : 0.0) << " MB/s\n"
+         << "==============" << endl;
+    return counters.dropped == 0 ? 0 : 2;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "log_manager.hpp"
+#include <string>
+#include <utility>
+
+// Асинхронная запись для сопрограмм C++20 (сборка с -DJOURNAL_CXX20=ON).
+//
+//     bool ok = co_await log_async(manager, "saved", importances::HIGH, Durability::SYNCED);
+//
+// Сопрограмма приостанавливается до нужной гарантии и не блокирует поток:
+// тысячи ожидающих записей обслуживает поток записи LogManager. Продолжение
+// выполняется в потоке записи, поэтому долгую работу после co_await
+// следует передавать своему исполнителю. QUEUED не приостанавливает
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+
+#define JOURNAL_HAS_COROUTINES 1
+
+class LogAwaiter {
+public:
+    LogAwaiter(LogManager& manager, std::string message, importances importance,
+               Durability durability)
+        : m_manager(manager), m_message(std::move(message)),
+          m_importance(importance), m_durability(durability) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        if (m_durability == Durability::QUEUED) {
+            // QUEUED завершается сразу (false - менеджер остановлен)
+            m_manager.log(m_message, m_importance, m_durability, [this](bool ok) { m_ok = ok; });
+            return false;
+        }
+        // Уведомление может прийти до выхода из await_suspend, поэтому
+        // после log к полям ожидания обращаться нельзя
+        m_manager.log(m_message, m_importance, m_durability, [this, handle](bool ok) {
+            m_ok = ok;
+            handle.resume();
+        });
+        return true;
+    }
+
+    // Результат уведомления о завершении
+    bool await_resume() const noexcept { return m_ok; }
+
+private:
+    LogManager& m_manager;
+    std::string m_message;
+    importances m_importance;
+    Durability m_durability;
+    bool m_ok = true;
+};
+
+inline LogAwaiter log_async(LogManager& manager, std::string message, importances importance,
+                            Durability durability = Durability::WRITTEN) {
+    return LogAwaiter(manager, std::move(message), importance, durability);
+}
+
+// Простейшая сопрограмма "запустить и забыть": выполняется сразу,
+// кадр освобождается по завершении
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+#endif
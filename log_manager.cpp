@@ -0,0 +1,864 @@
+#include "log_manager.hpp"
+#include "journal_probes.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+
+using namespace std;
+
+// BufferPool
+BufferPool::BufferPool(size_t max_buffers, size_t max_capacity)
+    : m_max_buffers(max_buffers), m_max_capacity(max_capacity) {
+    m_free.reserve(max_buffers);
+}
+
+void BufferPool::reserve(size_t count, size_t capacity) {
+    lock_guard<mutex> lock(m_mutex);
+    while (m_free.size() < min(count, m_max_buffers)) {
+        string buffer;
+        buffer.reserve(capacity);
+        m_free.push_back(move(buffer));
+    }
+}
+
+string BufferPool::acquire() {
+    lock_guard<mutex> lock(m_mutex);
+    if (m_free.empty()) {
+        return string();
+    }
+    string buffer = move(m_free.back());
+    m_free.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(string&& buffer) {
+    buffer.clear(); // Емкость сохраняется
+    if (buffer.capacity() > m_max_capacity) {
+        return; // Слишком большие буферы освобождаются
+    }
+    lock_guard<mutex> lock(m_mutex);
+    if (m_free.size() < m_max_buffers) {
+        m_free.push_back(move(buffer));
+    }
+}
+
+// LogQueue
+void LogQueue::Lane::push(Task&& task) {
+    if (size == ring.size()) {
+        grow();
+    }
+    ring[(head + size) % ring.size()] = move(task);
+    size++;
+    pushed++;
+}
+
+void LogQueue::Lane::grow() {
+    vector<Task> larger(max<size_t>(ring.size() * 2, 256));
+    for (size_t i = 0; i < size; ++i) {
+        larger[i] = move(ring[(head + i) % ring.size()]);
+    }
+    ring.swap(larger);
+    head = 0;
+}
+
+void LogQueue::push_locked(Task&& task) {
+    task.arrival = m_next_arrival++;
+    m_bytes += task.message.size();
+    JOURNAL_PROBE(log__enqueue, task.arrival, task.message.size(),
+                  static_cast<int>(task.importance), static_cast<int64_t>(task.timestamp));
+    m_lanes[lane_index(task.importance)].push(move(task));
+    m_size++;
+}
+
+bool LogQueue::push(Task& task) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_stop) {
+            return false;
+        }
+        push_locked(move(task));
+    }
+    m_condition.notify_one();
+    return true;
+}
+
+bool LogQueue::push_batch(vector<Task>& tasks) {
+    return push_tasks(tasks, false);
+}
+
+void LogQueue::requeue_batch(vector<Task>& tasks) {
+    push_tasks(tasks, true);
+}
+
+bool LogQueue::push_tasks(vector<Task>& tasks, bool after_stop) {
+    if (tasks.empty()) return true;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_stop && !after_stop) {
+            return false;
+        }
+        for (Task& task : tasks) {
+            push_locked(move(task));
+        }
+    }
+    tasks.clear();
+    m_condition.notify_all();
+    return true;
+}
+
+size_t LogQueue::select_lane() {
+    size_t chosen = LOG_LANES;
+    switch (m_options.policy) {
+    case LanePolicy::FIFO:
+        // Полоса с самой ранней задачей
+        for (size_t i = 0; i < LOG_LANES; ++i) {
+            const Lane& lane = m_lanes[i];
+            if (lane.size > 0 && (chosen == LOG_LANES ||
+                lane.ring[lane.head].arrival < m_lanes[chosen].ring[m_lanes[chosen].head].arrival)) {
+                chosen = i;
+            }
+        }
+        break;
+
+    case LanePolicy::STRICT:
+        // Старшая непустая полоса, если младшая не ждет слишком долго
+        for (size_t i = LOG_LANES; i-- > 0;) {
+            if (m_lanes[i].size == 0) continue;
+            if (chosen == LOG_LANES) {
+                chosen = i;
+            } else if (m_options.starvation_limit > 0 && 
+                       m_lanes[i].skipped >= m_options.starvation_limit) {
+                chosen = i;
+                break;
+            }
+        }
+        for (size_t i = 0; i < chosen; ++i) {
+            if (m_lanes[i].size > 0) m_lanes[i].skipped++;
+        }
+        m_lanes[chosen].skipped = 0;
+        break;
+
+    case LanePolicy::WEIGHTED: {
+        // Плавный взвешенный обход: каждая непустая полоса копит свой вес,
+        // выбранная отдает сумму весов. За цикл полоса получает долю,
+        // пропорциональную весу, без длинных серий одной полосы
+        int total = 0;
+        for (size_t i = LOG_LANES; i-- > 0;) {
+            Lane& lane = m_lanes[i];
+            if (lane.size == 0) {
+                lane.credit = 0;
+                continue;
+            }
+            lane.credit += static_cast<int>(m_options.weights[i]);
+            total += static_cast<int>(m_options.weights[i]);
+            if (chosen == LOG_LANES || lane.credit > m_lanes[chosen].credit) {
+                chosen = i;
+            }
+        }
+        m_lanes[chosen].credit -= total;
+        break;
+    }
+    }
+    return chosen;
+}
+
+bool LogQueue::pop(Task& task) {
+    unique_lock<mutex> lock(m_mutex);
+    // Ждем пока не появится задача или не придет сигнал остановки
+    m_condition.wait(lock, [this]() { return m_size > 0 || m_stop; });
+    
+    if (m_stop && m_size == 0) {
+        return false;
+    }
+    
+    Lane& lane = m_lanes[select_lane()];
+    task = move(lane.ring[lane.head]);
+    lane.head = (lane.head + 1) % lane.ring.size();
+    lane.size--;
+    m_size--;
+    m_bytes -= task.message.size();
+    task.sequence = m_next_sequence++;
+    return true;
+}
+
+void LogQueue::shutdown() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+}
+
+array<uint64_t, LOG_LANES> LogQueue::pushed() {
+    lock_guard<mutex> lock(m_mutex);
+    array<uint64_t, LOG_LANES> counts;
+    for (size_t i = 0; i < LOG_LANES; ++i) {
+        counts[i] = m_lanes[i].pushed;
+    }
+    return counts;
+}
+
+uint64_t LogQueue::bytes() {
+    lock_guard<mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+void LogQueue::reserve(size_t capacity) {
+    lock_guard<mutex> lock(m_mutex);
+    for (Lane& lane : m_lanes) {
+        while (lane.ring.size() < capacity) {
+            lane.grow();
+        }
+    }
+}
+
+void LogQueue::set_options(const LaneOptions& options) {
+    lock_guard<mutex> lock(m_mutex);
+    m_options = options;
+}
+
+// ReorderBuffer
+void ReorderBuffer::put(uint64_t sequence, Record record) {
+    bool is_next;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        while (sequence - m_next >= m_slots.size()) {
+            grow();
+        }
+        Slot& slot = m_slots[sequence % m_slots.size()];
+        slot.record = move(record);
+        slot.ready = true;
+        m_ready++;
+        is_next = (sequence == m_next);
+    }
+    // Поток записи ждет только следующую по порядку запись
+    if (is_next) {
+        m_condition.notify_one();
+    }
+}
+
+bool ReorderBuffer::next_ready() {
+    lock_guard<mutex> lock(m_mutex);
+    return m_slots[m_next % m_slots.size()].ready;
+}
+
+bool ReorderBuffer::take_next(Record& record) {
+    unique_lock<mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() {
+        return m_slots[m_next % m_slots.size()].ready || (m_stop && m_ready == 0);
+    });
+
+    Slot& slot = m_slots[m_next % m_slots.size()];
+    if (!slot.ready) {
+        return false;
+    }
+
+    record = move(slot.record);
+    slot.ready = false;
+    m_ready--;
+    m_next++;
+    return true;
+}
+
+void ReorderBuffer::shutdown() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+}
+
+void ReorderBuffer::reserve(size_t capacity) {
+    lock_guard<mutex> lock(m_mutex);
+    while (m_slots.size() < capacity) {
+        grow();
+    }
+}
+
+void ReorderBuffer::grow() {
+    vector<Slot> slots(m_slots.size() * 2);
+    for (uint64_t seq = m_next; seq < m_next + m_slots.size(); ++seq) {
+        slots[seq % slots.size()] = move(m_slots[seq % m_slots.size()]);
+    }
+    m_slots.swap(slots);
+}
+
+// ILogger
+void ILogger::log(const string& message, importances importance,
+                  initializer_list<LogField> fields) {
+    RouteMask mask = route(message, importance);
+    string encoded;
+    for (const LogField& field : fields) {
+        append_log_field(encoded, field);
+    }
+    string record;
+    if (mask != ROUTE_DROP && format(message, importance, time(nullptr), encoded, record)) {
+        write_to(record, mask);
+    }
+}
+
+// FileLogger
+FileLogger::FileLogger(const string& filename, importances default_level)
+    : logger(filename, default_level) {}
+
+FileLogger::FileLogger(unique_ptr<LogOutput> output, importances default_level)
+    : logger(move(output), default_level) {}
+
+importances FileLogger::get_default_importance() const {
+    return logger.get_default_importance();
+}
+
+bool FileLogger::format(const string& message, importances importance,
+                        time_t timestamp, string_view fields, string& out) const {
+    return logger.prepare_record(message, importance, timestamp, out, fields);
+}
+
+void FileLogger::write(const string& record) {
+    logger.write_record(record);
+}
+
+void FileLogger::sync() {
+    logger.sync();
+}
+
+// SocketFileLogger
+SocketFileLogger::SocketFileLogger(const string& host, int port, 
+                                   const string& filename, importances default_level)
+    : socket_logger(host, port, default_level),
+      file_logger(filename, default_level) {}
+
+SocketFileLogger::SocketFileLogger(unique_ptr<LogOutput> remote,
+                                   const string& filename, importances default_level)
+    : socket_logger(move(remote), default_level),
+      file_logger(filename, default_level) {}
+
+SocketFileLogger::SocketFileLogger(unique_ptr<LogOutput> remote, unique_ptr<LogOutput> file,
+                                   importances default_level)
+    : socket_logger(move(remote), default_level),
+      file_logger(move(file), default_level) {}
+
+importances SocketFileLogger::get_default_importance() const {
+    return file_logger.get_default_importance(); // Используем уровень из file_logger
+}
+
+bool SocketFileLogger::format(const string& message, importances importance,
+                              time_t timestamp, string_view fields, string& out) const {
+    // Формат записи одинаков для обоих выводов
+    return file_logger.prepare_record(message, importance, timestamp, out, fields);
+}
+
+void SocketFileLogger::write(const string& record) {
+    try {
+        socket_logger.write_record(record);
+    } catch (const runtime_error& e) {
+        cerr << "Socket error: " << e.what() << endl;
+        cerr << "Message saved to file only" << endl;
+    }
+    file_logger.write_record(record); // Всегда пишем в файл
+}
+
+void SocketFileLogger::sync() {
+    // Гарантия относится к файлу: сокет и кольцо не буферизуют записи
+    socket_logger.sync();
+    file_logger.sync();
+}
+
+// LogManager
+void LogManager::complete(LogCompletion& done, bool ok) {
+    // Исключение из уведомления не должно останавливать вывод
+    try {
+        done(ok);
+    } catch (const exception& e) {
+        cerr << "Completion error: " << e.what() << endl;
+    }
+    done = nullptr;
+}
+
+LogManager::LogManager(unique_ptr<ILogger> logger, size_t format_workers,
+                       size_t queue_capacity) 
+    : m_logger(move(logger)), m_format_workers(max<size_t>(format_workers, 1)),
+      m_dispatch_window(max(LaneOptions().dispatch_window, m_format_workers)) {
+    m_queue.reserve(queue_capacity);
+    m_reorder.reserve(queue_capacity);
+    // Каждому сообщению в обработке нужны буфер текста и буфер записи
+    m_buffers.reserve(queue_capacity * 2, LOG_BUFFER_CAPACITY);
+}
+
+void LogManager::set_lane_options(const LaneOptions& options) {
+    m_queue.set_options(options);
+    lock_guard<mutex> lock(m_flush_mutex);
+    // Каждому потоку форматирования нужна хотя бы одна задача
+    m_dispatch_window = max(options.dispatch_window, m_format_workers);
+}
+
+LogManager::~LogManager() {
+    stop();
+}
+
+void LogManager::start() {
+    for (size_t i = 0; i < m_format_workers; ++i) {
+        m_workers.emplace_back(&LogManager::process_tasks, this);
+    }
+    m_writer = thread(&LogManager::write_records, this);
+}
+
+void LogManager::stop() {
+    {
+        // Флаг сбрасывается под блокировкой вытеснения: запись, вытесненная
+        // на диск до этого момента, попадет в очередь до ее остановки, а
+        // после него вытеснение отказывает (см. enqueue)
+        lock_guard<mutex> lock(m_spill_mutex);
+        if (!m_running) return;
+        m_running = false;
+    }
+    // Сначала дорабатывают потоки форматирования, затем поток записи
+    // выводит все оставшиеся записи по порядку
+    m_queue.shutdown();
+    for (thread& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    m_reorder.shutdown();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+    // Записи, которые не удалось прочитать из файла вытеснения, выводить
+    // уже некому: их уведомления не должны ждать вечно
+    lock_guard<mutex> lock(m_spill_mutex);
+    for (LogCompletion& done : m_spill_done) {
+        complete(done, false);
+    }
+    m_spill_done.clear();
+}
+
+void LogManager::log(const string& message, importances importance) {
+    string buffer = m_buffers.acquire();
+    buffer.assign(message);
+    LogQueue::Task task(move(buffer), importance, time(nullptr));
+    enqueue(task);
+}
+
+void LogManager::log(const string& message, importances importance,
+                     initializer_list<LogField> fields) {
+    log(message, importance, Durability::QUEUED, nullptr, fields);
+}
+
+void LogManager::log(const string& message, importances importance,
+                     Durability durability, LogCompletion done,
+                     initializer_list<LogField> fields) {
+    string buffer = m_buffers.acquire();
+    buffer.assign(message);
+    LogQueue::Task task(move(buffer), importance, time(nullptr));
+    for (const LogField& field : fields) {
+        append_log_field(task.fields, field);
+    }
+    if (durability == Durability::QUEUED) {
+        bool accepted = enqueue(task);
+        if (done) {
+            complete(done, accepted);
+        }
+        return;
+    }
+    task.durability = durability;
+    task.done = move(done);
+    if (!enqueue(task) && task.done) {
+        complete(task.done, false);
+    }
+}
+
+size_t LogManager::log_batch(vector<LogQueue::Task>& tasks) {
+    const size_t count = tasks.size();
+    if (count == 0) return 0;
+    size_t accepted = 0;
+    if (m_memory_budget == 0) {
+        // Очередь отказывает и тогда, когда остановка идет одновременно с вызовом
+        if (m_running && m_queue.push_batch(tasks)) {
+            accepted = count;
+        }
+    } else {
+        uint64_t batch_bytes = 0;
+        for (const LogQueue::Task& task : tasks) {
+            batch_bytes += task.message.size();
+        }
+        // Флаг проверяется под блокировкой вытеснения, как в enqueue
+        lock_guard<mutex> lock(m_spill_mutex);
+        if (m_running && !m_spilling) {
+            uint64_t queued = m_queue.bytes();
+            if (queued == 0 || queued + batch_bytes <= m_memory_budget) {
+                if (m_queue.push_batch(tasks)) {
+                    accepted = count;
+                }
+            } else {
+                m_spilling = true;
+            }
+        }
+        if (m_running && m_spilling) {
+            // Не записанные в файл задачи остаются в начале tasks
+            size_t kept = 0;
+            for (LogQueue::Task& task : tasks) {
+                try {
+                    spill_locked(task);
+                    accepted++;
+                } catch (const exception& e) {
+                    cerr << "Spill error: " << e.what() << endl;
+                    if (&tasks[kept] != &task) {
+                        tasks[kept] = move(task);
+                    }
+                    kept++;
+                }
+            }
+            tasks.resize(kept);
+            if (m_queue.bytes() == 0) {
+                refill_locked();
+            }
+        }
+    }
+    // Отклоненные задачи: текст в пул, уведомления - с false (без блокировки)
+    for (LogQueue::Task& task : tasks) {
+        m_buffers.release(move(task.message));
+        if (task.done) {
+            complete(task.done, false);
+        }
+    }
+    tasks.clear();
+    return accepted;
+}
+
+bool LogManager::enqueue(LogQueue::Task& task) {
+    // Очередь отказывает и тогда, когда остановка идет одновременно с вызовом
+    if (!m_running) {
+        m_buffers.release(move(task.message));
+        return false;
+    }
+    if (m_memory_budget == 0) {
+        if (!m_queue.push(task)) {
+            m_buffers.release(move(task.message));
+            return false;
+        }
+        return true;
+    }
+    lock_guard<mutex> lock(m_spill_mutex);
+    // Остановка могла начаться после проверки выше: вытесненную теперь
+    // запись поток форматирования уже не прочитал бы
+    if (!m_running) {
+        m_buffers.release(move(task.message));
+        return false;
+    }
+    if (!m_spilling) {
+        // Запись больше всего бюджета принимается в пустую очередь
+        uint64_t queued = m_queue.bytes();
+        if (queued == 0 || queued + task.message.size() <= m_memory_budget) {
+            if (!m_queue.push(task)) {
+                m_buffers.release(move(task.message));
+                return false;
+            }
+            return true;
+        }
+        m_spilling = true;
+    }
+    try {
+        spill_locked(task);
+    } catch (const exception& e) {
+        cerr << "Spill error: " << e.what() << endl;
+        m_buffers.release(move(task.message));
+        return false;
+    }
+    // Очередь могла опустеть до установки m_spilling, и поток форматирования
+    // не заметил вытеснения: тогда пополнить очередь больше некому
+    if (m_queue.bytes() == 0) {
+        refill_locked();
+    }
+    return true;
+}
+
+void LogManager::spill_locked(LogQueue::Task& task) {
+    // Флаги: бит 0 - есть уведомление, биты 1-2 - Durability
+    uint8_t flags = static_cast<uint8_t>(static_cast<uint8_t>(task.durability) << 1);
+    if (task.done) {
+        flags |= 1;
+    }
+    // Уведомление сохраняется, только когда запись попала в файл: иначе
+    // уведомления сдвинулись бы относительно записей при чтении
+    m_spill.append(task.message, task.fields, task.importance, task.timestamp,
+                   task.producer, flags);
+    if (task.done) {
+        m_spill_done.push_back(move(task.done));
+    }
+    m_spill_pending[lane_index(task.importance)]++;
+    m_spilled++;
+    m_buffers.release(move(task.message));
+}
+
+void LogManager::refill_locked() {
+    // Пополнение в пределах бюджета; в пустую очередь - хотя бы одна запись
+    uint64_t queued = m_queue.bytes();
+    LogQueue::Task task;
+    task.message = m_buffers.acquire();
+    try {
+        while (!m_spill.empty()) {
+            if (queued + m_spill.next_length() > m_memory_budget && 
+                (queued > 0 || !m_refill.empty())) {
+                break;
+            }
+            uint8_t flags;
+            if (!m_spill.read(task.message, task.fields, task.importance, task.timestamp,
+                              task.producer, flags)) {
+                break;
+            }
+            task.durability = static_cast<Durability>(flags >> 1);
+            if (flags & 1) {
+                task.done = move(m_spill_done.front());
+                m_spill_done.pop_front();
+            }
+            m_spill_pending[lane_index(task.importance)]--;
+            queued += task.message.size();
+            m_refill.push_back(move(task));
+            task = LogQueue::Task();
+            task.message = m_buffers.acquire();
+        }
+    } catch (const exception& e) {
+        // Чтение (или дозапись буфера перед ним) не удалось: непрочитанные
+        // записи остаются в файле до следующего пополнения
+        cerr << "Spill error: " << e.what() << endl;
+    }
+    m_buffers.release(move(task.message));
+    m_queue.requeue_batch(m_refill);
+    // Файл прочитан целиком: новые записи снова идут прямо в очередь
+    if (m_spill.empty()) {
+        m_spilling = false;
+    }
+}
+
+void LogManager::set_memory_budget(size_t bytes, const string& spill_path) {
+    lock_guard<mutex> lock(m_spill_mutex);
+    if (bytes > 0 && !m_spill.is_open()) {
+        m_spill.open(spill_path);
+    }
+    m_memory_budget = bytes;
+}
+
+uint64_t LogManager::spilled() {
+    lock_guard<mutex> lock(m_spill_mutex);
+    return m_spilled;
+}
+
+void LogManager::flush() {
+    // Полосы выбираются в разном порядке, но внутри полосы порядок
+    // сохраняется, поэтому достаточно дождаться счетчиков каждой полосы.
+    // Записи в файле вытеснения учитываются вместе с очередью: перенос
+    // из файла в очередь идет под той же блокировкой
+    array<uint64_t, LOG_LANES> target;
+    {
+        lock_guard<mutex> lock(m_spill_mutex);
+        target = m_queue.pushed();
+        for (size_t i = 0; i < LOG_LANES; ++i) {
+            target[i] += m_spill_pending[i];
+        }
+    }
+    unique_lock<mutex> lock(m_flush_mutex);
+    m_flush_waiters++;
+    m_flush_condition.wait(lock, [this, &target]() { 
+        for (size_t i = 0; i < LOG_LANES; ++i) {
+            if (m_completed[i] < target[i]) return false;
+        }
+        return true;
+    });
+    m_flush_waiters--;
+}
+
+void LogManager::process_tasks() {
+    // pop возвращает false только после остановки и опустошения очереди
+    LogQueue::Task task;
+    while (true) {
+        // Задача берется из очереди, только когда в обработке меньше
+        // dispatch_window записей: иначе при медленном выводе задачи
+        // копились бы в буфере порядка и полосы очереди теряли бы смысл
+        {
+            unique_lock<mutex> lock(m_flush_mutex);
+            m_window_condition.wait(lock, [this]() { 
+                return m_in_flight < m_dispatch_window; 
+            });
+            m_in_flight++;
+        }
+        if (!m_queue.pop(task)) {
+            lock_guard<mutex> lock(m_flush_mutex);
+            m_in_flight--;
+            break;
+        }
+        JOURNAL_PROBE(log__dequeue, task.arrival, task.sequence, task.message.size(),
+                      static_cast<int>(task.importance));
+        // Вывод догоняет: очередь пополняется из файла вытеснения
+        if (m_spilling && m_queue.bytes() <= m_memory_budget / 2) {
+            lock_guard<mutex> lock(m_spill_mutex);
+            if (m_spilling) {
+                refill_locked();
+            }
+        }
+
+        ReorderBuffer::Record record;
+        record.text = m_buffers.acquire();
+        record.lane = static_cast<uint8_t>(lane_index(task.importance));
+        record.durability = task.durability;
+        record.done = move(task.done);
+        record.producer = task.producer;
+        try {
+            record.route = m_logger->route(task.message, task.importance);
+            record.skip = record.route == ROUTE_DROP ||
+                          !m_logger->format(task.message, task.importance, 
+                                            task.timestamp, task.fields, record.text);
+        } catch (const exception& e) {
+            cerr << "Logging error: " << e.what() << endl;
+            record.skip = true;
+            record.failed = true;
+        }
+        m_buffers.release(move(task.message));
+        // Номер занимается даже пропущенной записью, иначе порядок застопорится
+        m_reorder.put(task.sequence, move(record));
+    }
+}
+
+void LogManager::write_records() {
+    ReorderBuffer::Record record;
+    // Уведомления SYNCED, ожидающие общего sync
+    vector<LogCompletion> unsynced;
+    unsynced.reserve(LOG_SYNC_GROUP);
+    while (m_reorder.take_next(record)) {
+        bool ok = !record.failed;
+        if (!record.skip) {
+            try {
+                set_log_producer(record.producer);
+                m_logger->write_to(record.text, record.route);
+            } catch (const exception& e) {
+                cerr << "Logging error: " << e.what() << endl;
+                ok = false;
+            }
+        }
+        // Буфер возвращается в пул для следующих сообщений
+        m_buffers.release(move(record.text));
+
+        if (record.done) {
+            if (record.durability == Durability::SYNCED && ok && !record.skip) {
+                unsynced.push_back(move(record.done));
+            } else {
+                complete(record.done, ok);
+            }
+        }
+        // Один sync на группу записей: когда следующих записей пока нет
+        // или группа заполнена
+        if (!unsynced.empty() &&
+            (unsynced.size() >= LOG_SYNC_GROUP || !m_reorder.next_ready())) {
+            bool synced = true;
+            try {
+                m_logger->sync();
+            } catch (const exception& e) {
+                cerr << "Sync error: " << e.what() << endl;
+                synced = false;
+            }
+            for (LogCompletion& done : unsynced) {
+                complete(done, synced);
+            }
+            unsynced.clear();
+        }
+
+        lock_guard<mutex> lock(m_flush_mutex);
+        m_completed[record.lane]++;
+        m_in_flight--;
+        m_window_condition.notify_one();
+        if (m_flush_waiters > 0) {
+            m_flush_condition.notify_all();
+        }
+    }
+}
+
+// Пакетный прием
+namespace {
+
+// Разбор необязательного префикса уровня, префикс отрезается от строки
+importances parse_level_prefix(string_view& line, importances default_level) {
+    static const struct {
+        string_view tag;
+        importances level;
+    } prefixes[] = {
+        {"[LOW]", importances::LOW},
+        {"[MEDIUM]", importances::MEDIUM},
+        {"[HIGH]", importances::HIGH},
+    };
+
+    for (const auto& prefix : prefixes) {
+        if (line.size() >= prefix.tag.size() && 
+            line.compare(0, prefix.tag.size(), prefix.tag) == 0) {
+            line.remove_prefix(prefix.tag.size());
+            if (!line.empty() && line.front() == ' ') {
+                line.remove_prefix(1);
+            }
+            return prefix.level;
+        }
+    }
+    return default_level;
+}
+
+} // namespace
+
+size_t ingest_batch(int fd, LogManager& manager, importances default_level) {
+    vector<char> buffer(BATCH_READ_SIZE);
+    vector<LogQueue::Task> batch;
+    batch.reserve(BATCH_MAX_TASKS);
+    size_t pending = 0; // Незавершенная строка в начале буфера
+    size_t total = 0;
+    time_t now = time(nullptr);
+
+    auto add_line = [&](string_view line) {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        importances level = parse_level_prefix(line, default_level);
+        if (line.empty()) return;
+
+        string buffer = manager.acquire_buffer();
+        buffer.assign(line);
+        batch.push_back({move(buffer), level, now});
+        if (batch.size() >= BATCH_MAX_TASKS) {
+            total += manager.log_batch(batch);
+        }
+    };
+
+    while (true) {
+        // Строка длиннее буфера передается частями
+        if (pending == buffer.size()) {
+            add_line(string_view(buffer.data(), pending));
+            pending = 0;
+        }
+
+        ssize_t bytes = read(fd, buffer.data() + pending, buffer.size() - pending);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            throw runtime_error("Batch read failed: " + string(strerror(errno)));
+        }
+        if (bytes == 0) break;
+        now = time(nullptr);
+
+        const char* begin = buffer.data();
+        const char* end = buffer.data() + pending + bytes;
+        const char* line_start = begin;
+        while (const char* newline = static_cast<const char*>(
+                   memchr(line_start, '\n', end - line_start))) {
+            add_line(string_view(line_start, newline - line_start));
+            line_start = newline + 1;
+        }
+
+        // Переносим хвост без перевода строки в начало буфера
+        pending = end - line_start;
+        memmove(buffer.data(), line_start, pending);
+    }
+
+    if (pending > 0) {
+        add_line(string_view(buffer.data(), pending));
+    }
+    total += manager.log_batch(batch);
+    return total;
+}
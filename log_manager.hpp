@@ -0,0 +1,390 @@
+#pragma once
+#include "journal_lib.hpp"
+#include "spill_file.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <ctime>
+#include <cstdint>
+#include <array>
+#include <functional>
+#include <deque>
+
+// Маршрут записи - набор выводов логгера (бит i - вывод i)
+using RouteMask = uint32_t;
+constexpr RouteMask ROUTE_ALL = ~RouteMask(0);
+constexpr RouteMask ROUTE_DROP = 0;
+
+// Момент, после которого запись считается завершенной
+enum class Durability {
+    QUEUED,  // Принята в очередь
+    WRITTEN, // Передана выводу (файл, сокет, кольцо)
+    SYNCED   // Передана выводу и сброшена на устройство (ILogger::sync)
+};
+
+// Уведомление о завершении записи: ok == false при ошибке форматирования,
+// вывода или сброса. Запись, отфильтрованная по уровню, завершается с ok == true
+using LogCompletion = std::function<void(bool ok)>;
+
+// Сколько записей с Durability::SYNCED может ждать одного общего sync
+constexpr size_t LOG_SYNC_GROUP = 256;
+
+// Начальная емкость очереди и размер заранее выделенных буферов сообщений
+constexpr size_t LOG_QUEUE_CAPACITY = 1024;
+constexpr size_t LOG_BUFFER_CAPACITY = 256;
+
+// Пул переиспользуемых строковых буферов.
+// Буферы сохраняют выделенную емкость между сообщениями, поэтому в
+// установившемся режиме запись в журнал не обращается к куче
+class BufferPool {
+public:
+    // Буферы больше max_capacity байт не возвращаются в пул
+    explicit BufferPool(size_t max_buffers = 16384, size_t max_capacity = 64 * 1024);
+
+    // Заранее выделяет count буферов емкостью capacity
+    void reserve(size_t count, size_t capacity);
+    std::string acquire();
+    void release(std::string&& buffer);
+
+private:
+    std::vector<std::string> m_free;
+    size_t m_max_buffers;
+    size_t m_max_capacity;
+    std::mutex m_mutex;
+};
+
+// Число полос очереди (по одной на уровень важности)
+constexpr size_t LOG_LANES = 3;
+
+// Порядок выборки задач из полос
+enum class LanePolicy {
+    FIFO,     // В порядке поступления, как одна очередь
+    STRICT,   // Сначала старший уровень; младшие получают очередь по starvation_limit
+    WEIGHTED  // Взвешенный круговой обход по weights
+};
+
+struct LaneOptions {
+    LanePolicy policy = LanePolicy::FIFO;
+    // Доли полос LOW, MEDIUM, HIGH для WEIGHTED
+    std::array<unsigned, LOG_LANES> weights{1, 4, 16};
+    // Для STRICT: непустая младшая полоса, пропущенная столько раз подряд,
+    // получает следующую выборку (защита от голодания)
+    unsigned starvation_limit = 64;
+    // Сколько задач может быть выбрано из очереди, но еще не выведено.
+    // Ограничивает задержку HIGH при медленном выводе
+    size_t dispatch_window = 64;
+};
+
+// Потокобезопасная очередь задач с отдельной полосой на каждый уровень
+// важности: HIGH не ждет за накопившимися LOW, если политика это позволяет
+class LogQueue {
+public:
+    struct Task {
+        Task() = default;
+        Task(std::string message, importances importance, time_t timestamp)
+            : message(std::move(message)), importance(importance), timestamp(timestamp),
+              producer(current_log_producer()) {}
+
+        std::string message;
+        importances importance = importances::LOW;
+        time_t timestamp = 0;  // Время получения сообщения
+        // Порядковый номер выборки, назначается в pop. Запись выводится в
+        // этом порядке, поэтому приоритет полос сохраняется до вывода
+        uint64_t sequence = 0;
+        uint64_t arrival = 0;  // Номер поступления (для FIFO)
+        Durability durability = Durability::QUEUED;
+        LogCompletion done;    // Необязательное уведомление о завершении
+        uint32_t producer = 0; // Поток, создавший задачу (current_log_producer)
+        std::string fields;    // Закодированные поля (append_log_field), обычно пусто
+    };
+
+    // false - очередь остановлена, задача не изменена
+    bool push(Task& task);
+    // Добавление пачки задач под одной блокировкой (задачи перемещаются).
+    // false - очередь остановлена, задачи не изменены
+    bool push_batch(std::vector<Task>& tasks);
+    // Возврат задач, принятых раньше (из файла вытеснения): добавляются и
+    // после shutdown, пока потоки форматирования дорабатывают очередь
+    void requeue_batch(std::vector<Task>& tasks);
+
+    // Извлечение задачи по политике полос (блокировка)
+    bool pop(Task& task);
+
+    void shutdown();
+    // Число поступивших задач по полосам (для ожидания вывода)
+    std::array<uint64_t, LOG_LANES> pushed();
+    // Байт текста сообщений в очереди
+    uint64_t bytes();
+    // Заранее выделяет место под capacity задач в каждой полосе
+    void reserve(size_t capacity);
+    void set_options(const LaneOptions& options);
+
+private:
+    // Кольцевой буфер полосы: растет при переполнении и не сжимается,
+    // чтобы не выделять память в установившемся режиме
+    struct Lane {
+        std::vector<Task> ring;
+        size_t head = 0;
+        size_t size = 0;
+        uint64_t pushed = 0;
+        unsigned skipped = 0; // Пропусков подряд при непустой полосе (STRICT)
+        int credit = 0;       // Текущий счет взвешенного обхода (WEIGHTED)
+
+        void push(Task&& task);
+        void grow();
+    };
+
+    void push_locked(Task&& task);
+    bool push_tasks(std::vector<Task>& tasks, bool after_stop);
+    // Выбор полосы по политике (очередь не пуста)
+    size_t select_lane();
+
+    std::array<Lane, LOG_LANES> m_lanes;
+    size_t m_size = 0;
+    uint64_t m_bytes = 0;
+    LaneOptions m_options;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<bool> m_stop{false};
+    uint64_t m_next_arrival = 0;
+    uint64_t m_next_sequence = 0;
+};
+
+// Индекс полосы для уровня важности
+inline size_t lane_index(importances importance) {
+    return static_cast<size_t>(importance);
+}
+
+// Этап восстановления порядка: отформатированные записи приходят из
+// нескольких потоков в произвольном порядке и выдаются строго по
+// возрастанию sequence
+class ReorderBuffer {
+public:
+    struct Record {
+        std::string text;
+        bool skip = false;          // Запись отфильтрована или не отформатирована
+        RouteMask route = ROUTE_ALL; // Выводы, в которые попадет запись
+        uint8_t lane = 0;            // Полоса очереди (для flush)
+        bool failed = false;         // Ошибка форматирования
+        Durability durability = Durability::QUEUED;
+        LogCompletion done;
+        uint32_t producer = 0;       // Источник записи (для вывода по источникам)
+    };
+
+    void put(uint64_t sequence, Record record);
+    // Ожидание следующей по порядку записи. false - остановка и буфер пуст
+    bool take_next(Record& record);
+    // Готова ли следующая по порядку запись (без ожидания)
+    bool next_ready();
+    void shutdown();
+    // Заранее выделяет место под capacity записей
+    void reserve(size_t capacity);
+
+private:
+    struct Slot {
+        Record record;
+        bool ready = false;
+    };
+
+    // Ячейка записи с номером sequence - m_slots[sequence % размер]
+    void grow();
+
+    std::vector<Slot> m_slots = std::vector<Slot>(64);
+    uint64_t m_next = 0;
+    size_t m_ready = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+};
+
+// Базовый абстрактный класс для логгеров (файлового и сокетного). Расширяет функционал Journal_logger.
+// Работа разделена на два этапа: format может выполняться параллельно
+// в нескольких потоках, write вызывается из одного потока в порядке очереди
+class ILogger {
+public:
+    virtual ~ILogger() = default;
+    virtual importances get_default_importance() const = 0;
+
+    // Форматирование записи. fields - поля, закодированные append_log_field
+    // (пусто, если полей нет). false - запись не должна попасть в журнал
+    virtual bool format(const std::string& message, importances importance,
+                        time_t timestamp, std::string_view fields,
+                        std::string& out) const = 0;
+    // Вывод отформатированной записи
+    virtual void write(const std::string& record) = 0;
+
+    // Маршрутизация: выбор выводов для сообщения (вызывается параллельно
+    // вместе с format). По умолчанию запись идет во все выводы
+    virtual RouteMask route(const std::string& /*message*/, importances /*importance*/) const {
+        return ROUTE_ALL;
+    }
+    // Вывод записи только в выводы из route
+    virtual void write_to(const std::string& record, RouteMask /*route*/) {
+        write(record);
+    }
+    // Сброс выведенных записей на устройство (для Durability::SYNCED)
+    virtual void sync() {}
+
+    // Синхронная запись (форматирование и вывод в текущем потоке)
+    void log(const std::string& message, importances importance,
+             std::initializer_list<LogField> fields = {});
+};
+
+// Реализация логгера для работы с файлом
+class FileLogger : public ILogger {
+public:
+    FileLogger(const std::string& filename, importances default_level);
+    // Файловый вывод задается явно (например, MappedFileOutput)
+    FileLogger(std::unique_ptr<LogOutput> output, importances default_level);
+
+    importances get_default_importance() const override;
+    bool format(const std::string& message, importances importance,
+                time_t timestamp, std::string_view fields,
+                std::string& out) const override;
+    void write(const std::string& record) override;
+    void sync() override;
+
+private:
+    Journal_logger logger; // Композиция
+};
+
+// Комбинированный логгер (сокет + файл)
+class SocketFileLogger : public ILogger {
+public:
+    SocketFileLogger(const std::string& host, int port, 
+                     const std::string& filename, importances default_level);
+    // Удаленный вывод задается явно (например, кольцо в общей памяти)
+    SocketFileLogger(std::unique_ptr<LogOutput> remote,
+                     const std::string& filename, importances default_level);
+    SocketFileLogger(std::unique_ptr<LogOutput> remote, std::unique_ptr<LogOutput> file,
+                     importances default_level);
+
+    importances get_default_importance() const override;
+    bool format(const std::string& message, importances importance,
+                time_t timestamp, std::string_view fields,
+                std::string& out) const override;
+    void write(const std::string& record) override;
+    void sync() override;
+
+private:
+    Journal_logger socket_logger;
+    Journal_logger file_logger;
+};
+
+// Менеджер логгирования.
+// Форматирование выполняет пул из format_workers потоков, вывод - отдельный
+// поток записи, который получает записи через ReorderBuffer в исходном порядке.
+// Очередь, буфер порядка и пул строк выделяются заранее на queue_capacity
+// сообщений: пока в обработке не больше сообщений, куча не используется
+class LogManager {
+public:
+    LogManager(std::unique_ptr<ILogger> logger, size_t format_workers = 1,
+               size_t queue_capacity = LOG_QUEUE_CAPACITY);
+    ~LogManager();
+
+    void start();
+    // Остановка: задачи, уже попавшие в очередь, дописываются до конца
+    void stop();
+
+    // Добавление сообщения в очередь обработки
+    void log(const std::string& message, importances importance);
+    // Запись с типизированными полями ключ/значение. Поля кодируются при
+    // вызове, поэтому их строки не обязаны жить до вывода
+    void log(const std::string& message, importances importance,
+             std::initializer_list<LogField> fields);
+    // То же с уведомлением done, когда запись достигнет durability.
+    // QUEUED вызывает done сразу в текущем потоке, WRITTEN и SYNCED - из
+    // потока записи (done не должен блокироваться и вызывать flush/stop).
+    // Записи SYNCED сбрасываются общим sync, когда очередь вывода пустеет
+    // или накопилось LOG_SYNC_GROUP записей. После stop запись не
+    // принимается, done сразу вызывается с false
+    void log(const std::string& message, importances importance,
+             Durability durability, LogCompletion done,
+             std::initializer_list<LogField> fields = {});
+    // Добавление пачки сообщений (вектор опустошается). Возвращает число
+    // принятых; отклоненные (после stop или при ошибке вытеснения) не
+    // выводятся, их уведомления done вызываются с false
+    size_t log_batch(std::vector<LogQueue::Task>& tasks);
+    // Ожидание вывода всех сообщений, добавленных до вызова
+    void flush();
+    // Политика выборки из полос (до start)
+    void set_lane_options(const LaneOptions& options);
+    // Бюджет памяти очереди в байтах текста сообщений (до start). Сверх
+    // бюджета новые записи дописываются в файл вытеснения spill_path и
+    // возвращаются в очередь по порядку, когда вывод догоняет; записи не
+    // теряются. 0 - без ограничения (по умолчанию)
+    void set_memory_budget(size_t bytes, const std::string& spill_path);
+    // Байт текста в очереди и число записей, прошедших через файл вытеснения
+    uint64_t queued_bytes() { return m_queue.bytes(); }
+    uint64_t spilled();
+
+    // Буфер из пула для текста сообщения (для log_batch)
+    std::string acquire_buffer() { return m_buffers.acquire(); }
+
+    ILogger& get_logger() { return *m_logger; }
+
+private:
+    // Цикл потока форматирования
+    void process_tasks();
+    // Цикл потока записи
+    void write_records();
+    // Вызов уведомления о завершении
+    static void complete(LogCompletion& done, bool ok);
+    // Постановка в очередь с учетом бюджета памяти. Принятая задача
+    // перемещается; false - менеджер остановлен или запись в файл
+    // вытеснения не удалась, текст возвращен в пул, уведомление остается в задаче
+    bool enqueue(LogQueue::Task& task);
+    // Запись в файл вытеснения и возврат из него в очередь (под m_spill_mutex).
+    // spill_locked бросает исключение при ошибке записи, задача не изменена
+    void spill_locked(LogQueue::Task& task);
+    void refill_locked();
+
+    std::unique_ptr<ILogger> m_logger;
+    BufferPool m_buffers;
+    LogQueue m_queue;
+    ReorderBuffer m_reorder;
+    size_t m_format_workers;
+    std::vector<std::thread> m_workers;
+    std::thread m_writer;
+    std::atomic<bool> m_running{true};
+
+    // Число выведенных (или пропущенных) записей по полосам - для flush.
+    // Внутри полосы записи выводятся в порядке поступления
+    std::array<uint64_t, LOG_LANES> m_completed{};
+    // Выбранные из очереди, но еще не выведенные задачи (под m_flush_mutex)
+    size_t m_in_flight = 0;
+    size_t m_dispatch_window;
+    std::condition_variable m_window_condition;
+    size_t m_flush_waiters = 0;
+    std::mutex m_flush_mutex;
+    std::condition_variable m_flush_condition;
+
+    // Вытеснение на диск. Пока m_spilling, все новые записи идут в файл,
+    // чтобы сохранить порядок; очередь пополняется из файла, когда в ней
+    // остается меньше половины бюджета
+    size_t m_memory_budget = 0;
+    SpillFile m_spill;
+    std::atomic<bool> m_spilling{false};
+    // Записи в файле по полосам (для flush)
+    std::array<uint64_t, LOG_LANES> m_spill_pending{};
+    // Уведомления записей в файле (std::function не сериализуется)
+    std::deque<LogCompletion> m_spill_done;
+    uint64_t m_spilled = 0;
+    std::vector<LogQueue::Task> m_refill;
+    std::mutex m_spill_mutex;
+};
+
+// Размер блока чтения и пачки записей в пакетном режиме
+constexpr size_t BATCH_READ_SIZE = 1 << 20;
+constexpr size_t BATCH_MAX_TASKS = 4096;
+
+// Пакетный прием: читает строки из дескриптора большими блоками и передает
+// их в LogManager пачками. Строка может начинаться с префикса уровня
+// "[LOW]", "[MEDIUM]" или "[HIGH]", иначе используется default_level.
+// Пустые строки пропускаются. Возвращает число принятых записей
+// (строки, отклоненные log_batch, не учитываются)
+size_t ingest_batch(int fd, LogManager& manager, importances default_level);
@@ -0,0 +1,314 @@
+#include "log_router.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Пропуск пробелов по краям
+string_view trim(string_view text) {
+    const char* spaces = " \t\r";
+    size_t begin = text.find_first_not_of(spaces);
+    if (begin == string_view::npos) return {};
+    size_t end = text.find_last_not_of(spaces);
+    return text.substr(begin, end - begin + 1);
+}
+
+// Следующее слово строки; line сдвигается за него
+string_view next_token(string_view& line) {
+    line = trim(line);
+    size_t end = line.find_first_of(" \t");
+    string_view token = line.substr(0, end);
+    line = end == string_view::npos ? string_view() : line.substr(end);
+    return token;
+}
+
+importances parse_level(string_view text) {
+    if (text == "LOW") return importances::LOW;
+    if (text == "MEDIUM") return importances::MEDIUM;
+    if (text == "HIGH") return importances::HIGH;
+    throw invalid_argument("Unknown level " + string(text));
+}
+
+bool level_in(const RouteRule& rule, importances importance) {
+    return importance >= rule.min_level && importance <= rule.max_level;
+}
+
+} // namespace
+
+// PatternMatcher
+void PatternMatcher::add(string_view pattern, uint32_t value) {
+    if (pattern.empty()) {
+        throw invalid_argument("Pattern cannot be empty");
+    }
+    m_patterns.emplace_back(string(pattern), value);
+}
+
+void PatternMatcher::build() {
+    // Классы байтов: каждый байт из образцов - свой класс, остальные - класс 0
+    m_classes.fill(0);
+    m_class_count = 1;
+    for (const auto& [pattern, value] : m_patterns) {
+        for (unsigned char c : pattern) {
+            if (m_classes[c] == 0) {
+                m_classes[c] = static_cast<uint16_t>(m_class_count++);
+            }
+        }
+    }
+
+    // Бор. Отсутствующий переход - UINT32_MAX до построения автомата
+    constexpr uint32_t NONE = UINT32_MAX;
+    m_transitions.assign(m_class_count, NONE);
+    vector<vector<uint32_t>> outputs(1);
+    for (const auto& [pattern, value] : m_patterns) {
+        uint32_t state = 0;
+        for (unsigned char c : pattern) {
+            uint32_t& next = m_transitions[state * m_class_count + m_classes[c]];
+            if (next == NONE) {
+                next = static_cast<uint32_t>(outputs.size());
+                outputs.emplace_back();
+                m_transitions.resize(m_transitions.size() + m_class_count, NONE);
+            }
+            state = m_transitions[state * m_class_count + m_classes[c]];
+        }
+        outputs[state].push_back(value);
+    }
+
+    // Обход в ширину: суффиксные ссылки и достраивание переходов до
+    // полного автомата. Выходы состояния дополняются выходами его
+    // суффиксной ссылки, которая всегда ближе к корню и уже обработана
+    const size_t states = outputs.size();
+    vector<uint32_t> fail(states, 0);
+    vector<uint32_t> queue;
+    queue.reserve(states);
+    for (size_t c = 0; c < m_class_count; ++c) {
+        uint32_t& next = m_transitions[c];
+        if (next == NONE) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const uint32_t state = queue[head];
+        vector<uint32_t>& own = outputs[state];
+        const vector<uint32_t>& inherited = outputs[fail[state]];
+        own.insert(own.end(), inherited.begin(), inherited.end());
+        sort(own.begin(), own.end());
+        own.erase(unique(own.begin(), own.end()), own.end());
+
+        for (size_t c = 0; c < m_class_count; ++c) {
+            uint32_t& next = m_transitions[state * m_class_count + c];
+            const uint32_t fallback = m_transitions[fail[state] * m_class_count + c];
+            if (next == NONE) {
+                next = fallback;
+            } else {
+                fail[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    // Выходы всех состояний - в одном массиве
+    m_output_begin.assign(states + 1, 0);
+    m_outputs.clear();
+    for (size_t state = 0; state < states; ++state) {
+        m_output_begin[state] = static_cast<uint32_t>(m_outputs.size());
+        m_outputs.insert(m_outputs.end(), outputs[state].begin(), outputs[state].end());
+    }
+    m_output_begin[states] = static_cast<uint32_t>(m_outputs.size());
+}
+
+// LogRouter
+void LogRouter::add_rule(RouteRule rule) {
+    if (rule.min_level > rule.max_level) {
+        throw invalid_argument("Empty level range in routing rule");
+    }
+    m_rules.push_back(move(rule));
+}
+
+void LogRouter::compile() {
+    m_matcher = PatternMatcher();
+    const uint32_t count = static_cast<uint32_t>(m_rules.size());
+    m_unconditional.fill(count);
+    for (uint32_t index = 0; index < count; ++index) {
+        const RouteRule& rule = m_rules[index];
+        for (const string& pattern : rule.patterns) {
+            m_matcher.add(pattern, index);
+        }
+        if (rule.patterns.empty()) {
+            for (int level = 0; level < 3; ++level) {
+                if (level_in(rule, static_cast<importances>(level)) &&
+                    m_unconditional[level] == count) {
+                    m_unconditional[level] = index;
+                }
+            }
+        }
+    }
+    m_matcher.build();
+}
+
+RouteMask LogRouter::route(string_view message, importances importance) const {
+    // Лучшее правило - с наименьшим номером. Правила без подстрок известны
+    // заранее, поэтому проход нужен только ради правил перед ними
+    uint32_t best = m_unconditional[static_cast<int>(importance)];
+    if (best > 0) {
+        m_matcher.scan(message, [&](const uint32_t* begin, const uint32_t* end) {
+            // Номера правил в выходе отсортированы
+            for (const uint32_t* rule = begin; rule != end && *rule < best; ++rule) {
+                if (level_in(m_rules[*rule], importance)) {
+                    best = *rule;
+                    break;
+                }
+            }
+            return best > 0;
+        });
+    }
+    return best < m_rules.size() ? m_rules[best].sinks : m_default;
+}
+
+// Разбор файла маршрутов
+RouteConfig parse_route_config(istream& in, const vector<string>& known_sinks) {
+    RouteConfig config;
+    vector<string> names(known_sinks);
+    if (names.size() > MAX_ROUTE_SINKS) {
+        throw invalid_argument("Too many sinks");
+    }
+    config.router.set_default(names.size() == MAX_ROUTE_SINKS ? ROUTE_ALL
+                                                              : (RouteMask(1) << names.size()) - 1);
+
+    auto parse_sinks = [&names](string_view text) {
+        if (text == "drop") return ROUTE_DROP;
+        RouteMask mask = ROUTE_DROP;
+        while (!text.empty()) {
+            size_t comma = text.find(',');
+            string_view name = text.substr(0, comma);
+            auto found = find(names.begin(), names.end(), name);
+            if (found == names.end()) {
+                throw invalid_argument("Unknown sink " + string(name));
+            }
+            mask |= RouteMask(1) << (found - names.begin());
+            text = comma == string_view::npos ? string_view() : text.substr(comma + 1);
+        }
+        return mask;
+    };
+
+    string buffer;
+    size_t line_number = 0;
+    while (getline(in, buffer)) {
+        line_number++;
+        string_view line = trim(buffer);
+        if (line.empty() || line[0] == '#') continue;
+
+        try {
+            string_view keyword = next_token(line);
+            if (keyword == "sink") {
+                string name(next_token(line));
+                string file(trim(line));
+                if (name.empty() || file.empty()) {
+                    throw invalid_argument("Expected: sink <name> <file>");
+                }
+                if (find(names.begin(), names.end(), name) != names.end()) {
+                    throw invalid_argument("Duplicate sink " + name);
+                }
+                if (names.size() == MAX_ROUTE_SINKS) {
+                    throw invalid_argument("Too many sinks");
+                }
+                names.push_back(name);
+                config.file_sinks.emplace_back(move(name), move(file));
+            } else if (keyword == "default") {
+                config.router.set_default(parse_sinks(next_token(line)));
+            } else {
+                RouteRule rule;
+                if (keyword != "*") {
+                    size_t dash = keyword.find('-');
+                    rule.min_level = parse_level(keyword.substr(0, dash));
+                    rule.max_level = dash == string_view::npos ? rule.min_level
+                                                               : parse_level(keyword.substr(dash + 1));
+                }
+                string_view sinks = next_token(line);
+                if (sinks.empty()) {
+                    throw invalid_argument("Expected: <levels> <sinks|drop> [patterns]");
+                }
+                rule.sinks = parse_sinks(sinks);
+
+                line = trim(line);
+                while (!line.empty()) {
+                    size_t bar = line.find('|');
+                    string_view pattern = trim(line.substr(0, bar));
+                    if (pattern.empty()) {
+                        throw invalid_argument("Empty pattern");
+                    }
+                    rule.patterns.emplace_back(pattern);
+                    line = bar == string_view::npos ? string_view() : line.substr(bar + 1);
+                }
+                config.router.add_rule(move(rule));
+            }
+        } catch (const invalid_argument& e) {
+            throw invalid_argument("Routes line " + to_string(line_number) + ": " + e.what());
+        }
+    }
+
+    config.router.compile();
+    return config;
+}
+
+// RoutingLogger
+RoutingLogger::RoutingLogger(vector<Sink> sinks, LogRouter router)
+    : m_sinks(move(sinks)), m_router(move(router)) {
+    if (m_sinks.empty() || m_sinks.size() > MAX_ROUTE_SINKS) {
+        throw invalid_argument("RoutingLogger needs 1.." + to_string(MAX_ROUTE_SINKS) + " sinks");
+    }
+}
+
+importances RoutingLogger::get_default_importance() const {
+    return m_sinks.front().logger->get_default_importance();
+}
+
+bool RoutingLogger::format(const string& message, importances importance,
+                           time_t timestamp, string_view fields, string& out) const {
+    // Формат записи одинаков для всех выводов
+    return m_sinks.front().logger->prepare_record(message, importance, timestamp, out, fields);
+}
+
+void RoutingLogger::write(const string& record) {
+    write_to(record, ROUTE_ALL);
+}
+
+void RoutingLogger::sync() {
+    // Сбрасываются все выводы: какие из них получили записи группы, не известно
+    string failed;
+    for (Sink& sink : m_sinks) {
+        try {
+            sink.logger->sync();
+        } catch (const runtime_error& e) {
+            failed += (failed.empty() ? "" : "; ") + sink.name + ": " + e.what();
+        }
+    }
+    if (!failed.empty()) {
+        throw runtime_error("Sink sync failed: " + failed);
+    }
+}
+
+RouteMask RoutingLogger::route(const string& message, importances importance) const {
+    return m_router.route(message, importance);
+}
+
+void RoutingLogger::write_to(const string& record, RouteMask route) {
+    string failed;
+    for (size_t i = 0; i < m_sinks.size(); ++i) {
+        if (!(route & (RouteMask(1) << i))) continue;
+        // Ошибка одного вывода не мешает остальным, но запись не считается
+        // выведенной: исключение получит поток записи (уведомление с false)
+        try {
+            m_sinks[i].logger->write_record(record);
+        } catch (const runtime_error& e) {
+            failed += (failed.empty() ? "" : "; ") + m_sinks[i].name + ": " + e.what();
+        }
+    }
+    if (!failed.empty()) {
+        throw runtime_error("Sink write failed: " + failed);
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "log_manager.hpp"
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <istream>
+#include <cstdint>
+
+// Максимальное число выводов у маршрутизирующего логгера (разрядность RouteMask)
+constexpr size_t MAX_ROUTE_SINKS = 32;
+
+// Поиск множества подстрок за один проход (автомат Ахо-Корасик).
+// Переходы хранятся полной таблицей по классам байтов: байты, которые не
+// встречаются в образцах, образуют один класс, поэтому таблица компактна,
+// а шаг автомата - одно обращение к памяти без ветвлений
+class PatternMatcher {
+public:
+    // Добавление образца; value сообщается при каждом его вхождении
+    void add(std::string_view pattern, uint32_t value);
+    // Построение автомата (после всех add)
+    void build();
+    bool empty() const { return m_patterns.empty(); }
+
+    // Проход по тексту. В позиции, где оканчиваются образцы, вызывается
+    // on_match(begin, end) с их значениями по возрастанию;
+    // false из on_match прекращает поиск
+    template <typename Callback>
+    void scan(std::string_view text, Callback&& on_match) const;
+
+private:
+    std::vector<std::pair<std::string, uint32_t>> m_patterns;
+
+    // Класс байта (0 - нет в образцах). Классов до 257: все 256 байт и класс 0
+    std::array<uint16_t, 256> m_classes{};
+    size_t m_class_count = 1;
+    std::vector<uint32_t> m_transitions;  // [состояние * m_class_count + класс]
+    std::vector<uint32_t> m_output_begin; // Выходы состояния s: [begin[s], begin[s + 1])
+    std::vector<uint32_t> m_outputs;
+};
+
+template <typename Callback>
+void PatternMatcher::scan(std::string_view text, Callback&& on_match) const {
+    if (m_transitions.empty()) return;
+    uint32_t state = 0;
+    for (unsigned char c : text) {
+        state = m_transitions[state * m_class_count + m_classes[c]];
+        const uint32_t begin = m_output_begin[state];
+        const uint32_t end = m_output_begin[state + 1];
+        if (begin != end && !on_match(&m_outputs[begin], &m_outputs[end])) {
+            return;
+        }
+    }
+}
+
+// Правило маршрутизации
+struct RouteRule {
+    importances min_level = importances::LOW;
+    importances max_level = importances::HIGH;
+    std::vector<std::string> patterns; // Любая из подстрок (пусто - любое сообщение)
+    RouteMask sinks = ROUTE_DROP;      // Выводы (ROUTE_DROP - отбросить)
+};
+
+// Набор правил: срабатывает первое подходящее по порядку добавления.
+// Все подстроки всех правил собраны в один автомат, поэтому выбор маршрута
+// стоит одного прохода по сообщению независимо от числа правил
+class LogRouter {
+public:
+    void add_rule(RouteRule rule);
+    // Маршрут для сообщений, не подошедших ни под одно правило
+    void set_default(RouteMask sinks) { m_default = sinks; }
+    // Построение автомата (после всех add_rule)
+    void compile();
+
+    RouteMask route(std::string_view message, importances importance) const;
+    size_t rule_count() const { return m_rules.size(); }
+
+private:
+    std::vector<RouteRule> m_rules;
+    RouteMask m_default = ROUTE_ALL;
+    PatternMatcher m_matcher;
+    // Первое правило без подстрок для каждого уровня (или число правил)
+    std::array<uint32_t, 3> m_unconditional{};
+};
+
+// Разобранный файл маршрутов
+struct RouteConfig {
+    // Объявленные в файле выводы: имя и файл журнала
+    std::vector<std::pair<std::string, std::string>> file_sinks;
+    LogRouter router;
+};
+
+// Разбор файла маршрутов. Строки:
+//   sink <имя> <файл>                      - дополнительный файловый вывод
+//   default <выводы|drop>                  - маршрут по умолчанию
+//   <уровни> <выводы|drop> [подстрока|...] - правило
+// Уровни: LOW, MEDIUM, HIGH, диапазон LOW-MEDIUM или * (любой);
+// выводы перечисляются через запятую. Подстроки занимают остаток строки
+// и разделяются '|'. Пустые строки и строки с '#' пропускаются.
+// known_sinks - выводы, созданные без файла маршрутов (индексы 0..n-1,
+// маршрут по умолчанию); объявленные получают следующие индексы.
+// Ошибки сообщаются через invalid_argument с номером строки
+RouteConfig parse_route_config(std::istream& in, const std::vector<std::string>& known_sinks);
+
+// Логгер с несколькими выводами и маршрутизацией записей по правилам.
+// Формат записей общий, уровень по умолчанию берется у первого вывода.
+// Запись выводится во все выбранные выводы; если хотя бы один из них
+// отказал, write_to (и sync) бросает runtime_error после остальных
+class RoutingLogger : public ILogger {
+public:
+    struct Sink {
+        std::string name;
+        std::unique_ptr<Journal_logger> logger;
+    };
+
+    RoutingLogger(std::vector<Sink> sinks, LogRouter router);
+
+    importances get_default_importance() const override;
+    bool format(const std::string& message, importances importance,
+                time_t timestamp, std::string_view fields,
+                std::string& out) const override;
+    void write(const std::string& record) override;
+
+    RouteMask route(const std::string& message, importances importance) const override;
+    void write_to(const std::string& record, RouteMask route) override;
+    void sync() override;
+
+private:
+    std::vector<Sink> m_sinks;
+    LogRouter m_router;
+};
@@ -0,0 +1,231 @@
+#include "log_tail.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// События самого файла и каталога, в котором он лежит. Пока файл открыт,
+// удаление не дает IN_DELETE_SELF (inode жив), поэтому оно замечается по
+// IN_DELETE каталога и IN_ATTRIB файла (изменилось число ссылок)
+constexpr uint32_t FILE_EVENTS = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+constexpr uint32_t DIR_EVENTS = IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+
+// Выдача записи без завершающего '\r'; пустые строки пропускаются
+void emit(string_view record, const string& source, const LogTailer::Callback& callback) {
+    if (!record.empty() && record.back() == '\r') {
+        record.remove_suffix(1);
+    }
+    if (!record.empty()) {
+        callback(record, source);
+    }
+}
+
+} // namespace
+
+LogTailer::LogTailer(const vector<string>& paths) : m_buffer(TAIL_READ_SIZE) {
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify == -1) {
+        throw runtime_error("inotify_init failed: " + string(strerror(errno)));
+    }
+
+    m_files.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        File& file = m_files[i];
+        file.path = paths[i];
+        size_t slash = file.path.rfind('/');
+        string dir = slash == string::npos ? "." : file.path.substr(0, max<size_t>(slash, 1));
+        file.name = slash == string::npos ? file.path : file.path.substr(slash + 1);
+
+        // Каталог наблюдается всегда: в нем появится файл после ротации
+        int dir_watch = inotify_add_watch(m_inotify, dir.c_str(), DIR_EVENTS);
+        if (dir_watch == -1) {
+            string error = strerror(errno);
+            close(m_inotify);
+            throw runtime_error("Cannot watch directory " + dir + ": " + error);
+        }
+        m_dir_watches[dir_watch].push_back(i);
+
+        // Файла может еще не быть - тогда он будет прочитан с начала, когда появится
+        open_file(file, true);
+    }
+}
+
+LogTailer::~LogTailer() {
+    for (File& file : m_files) {
+        if (file.fd != -1) {
+            close(file.fd);
+        }
+    }
+    close(m_inotify);
+}
+
+bool LogTailer::open_file(File& file, bool at_end) {
+    int fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        close(fd);
+        return false;
+    }
+
+    file.fd = fd;
+    file.device = info.st_dev;
+    file.inode = info.st_ino;
+    file.offset = at_end ? lseek(fd, 0, SEEK_END) : 0;
+    file.pending.clear();
+    file.watch = inotify_add_watch(m_inotify, file.path.c_str(), FILE_EVENTS);
+    if (file.watch != -1) {
+        m_file_watches[file.watch] = &file - m_files.data();
+    }
+    return true;
+}
+
+void LogTailer::close_file(File& file, const Callback& callback) {
+    if (file.fd == -1) return;
+    read_file(file, callback);
+    emit(file.pending, file.path, callback);
+    file.pending.clear();
+
+    if (file.watch != -1) {
+        inotify_rm_watch(m_inotify, file.watch);
+        m_file_watches.erase(file.watch);
+        file.watch = -1;
+    }
+    close(file.fd);
+    file.fd = -1;
+}
+
+void LogTailer::read_file(File& file, const Callback& callback) {
+    if (file.fd == -1) return;
+
+    // Усечение: файл стал короче прочитанного - читаем заново с начала
+    struct stat info;
+    if (fstat(file.fd, &info) == 0 && info.st_size < file.offset) {
+        file.offset = lseek(file.fd, 0, SEEK_SET);
+        file.pending.clear();
+    }
+
+    while (true) {
+        ssize_t bytes = read(file.fd, m_buffer.data(), m_buffer.size());
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            cerr << "Read error in " << file.path << ": " << strerror(errno) << endl;
+            return;
+        }
+        if (bytes == 0) return;
+
+        const char* begin = m_buffer.data();
+        const char* end = begin + bytes;
+        // Метка порядка байтов, которую FileOutput пишет в начало журнала
+        if (file.offset == 0 && bytes >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0) {
+            begin += 3;
+        }
+        file.offset += bytes;
+
+        // Записи целиком внутри блока передаются без копирования
+        const char* line_start = begin;
+        while (const char* newline = static_cast<const char*>(
+                   memchr(line_start, '\n', end - line_start))) {
+            if (file.pending.empty()) {
+                emit(string_view(line_start, newline - line_start), file.path, callback);
+            } else {
+                file.pending.append(line_start, newline - line_start);
+                emit(file.pending, file.path, callback);
+                file.pending.clear();
+            }
+            line_start = newline + 1;
+        }
+        file.pending.append(line_start, end - line_start);
+        if (file.pending.size() > TAIL_MAX_RECORD) {
+            emit(file.pending, file.path, callback);
+            file.pending.clear();
+        }
+    }
+}
+
+void LogTailer::check_file(File& file, const Callback& callback) {
+    struct stat info;
+    if (stat(file.path.c_str(), &info) == -1) {
+        // Нового файла пока нет. Переименованный старый еще дочитывается,
+        // удаленный (ссылок не осталось) дочитывается и закрывается
+        if (file.fd != -1 && fstat(file.fd, &info) == 0 && info.st_nlink == 0) {
+            close_file(file, callback);
+        }
+        return;
+    }
+    if (file.fd != -1 && info.st_dev == file.device && info.st_ino == file.inode) {
+        read_file(file, callback);
+        return;
+    }
+    // Под именем теперь другой файл: старый дочитывается, новый читается с начала
+    close_file(file, callback);
+    if (open_file(file, false)) {
+        read_file(file, callback);
+    }
+}
+
+bool LogTailer::wait(int timeout_ms) {
+    pollfd poll_fd{m_inotify, POLLIN, 0};
+    return poll(&poll_fd, 1, timeout_ms) > 0;
+}
+
+void LogTailer::process(const Callback& callback) {
+    alignas(inotify_event) char events[16 * 1024];
+    while (true) {
+        ssize_t length = read(m_inotify, events, sizeof(events));
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) {
+                cerr << "inotify read error: " << strerror(errno) << endl;
+            }
+            return;
+        }
+
+        for (ssize_t pos = 0; pos < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(events + pos);
+            pos += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // События потеряны: проверяем все файлы
+                for (File& file : m_files) {
+                    check_file(file, callback);
+                }
+                continue;
+            }
+
+            auto dir = m_dir_watches.find(event->wd);
+            if (dir != m_dir_watches.end() && event->len > 0) {
+                for (size_t index : dir->second) {
+                    if (m_files[index].name == event->name) {
+                        check_file(m_files[index], callback);
+                    }
+                }
+            }
+
+            auto watched = m_file_watches.find(event->wd);
+            if (watched == m_file_watches.end()) continue;
+            File& file = m_files[watched->second];
+            if (event->mask & IN_MODIFY) {
+                read_file(file, callback);
+            }
+            if (event->mask & IN_DELETE_SELF) {
+                close_file(file, callback);
+            } else if (event->mask & (IN_MOVE_SELF | IN_ATTRIB)) {
+                // Переименован при ротации или удален, пока открыт: дочитываем,
+                // новый файл мог уже появиться
+                check_file(file, callback);
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <sys/types.h>
+
+// Размер блока чтения файла и максимальная длина записи без перевода строки
+constexpr size_t TAIL_READ_SIZE = 256 * 1024;
+constexpr size_t TAIL_MAX_RECORD = 64 * 1024;
+
+// Слежение за дописываемыми файлами журнала (как tail -F).
+// Изменения приходят через inotify, новые данные читаются большими блоками
+// и делятся на записи по переводу строки, поэтому системные вызовы не
+// зависят от числа строк. Файлы читаются с конца на момент запуска.
+// Ротация переименованием (новый файл с тем же именем), удаление и
+// усечение (copytruncate) обрабатываются: старый файл дочитывается до
+// конца (удаленный затем закрывается), после усечения чтение начинается
+// с начала
+class LogTailer {
+public:
+    // record - запись без перевода строки, source - путь файла
+    using Callback = std::function<void(std::string_view record, std::string_view source)>;
+
+    explicit LogTailer(const std::vector<std::string>& paths);
+    ~LogTailer();
+
+    LogTailer(const LogTailer&) = delete;
+    LogTailer& operator=(const LogTailer&) = delete;
+
+    // Ожидание изменений. false - таймаут или прерывание сигналом
+    bool wait(int timeout_ms);
+    // Обработка накопившихся событий (без блокировки)
+    void process(const Callback& callback);
+
+private:
+    struct File {
+        std::string path;
+        std::string name;    // Имя в каталоге (для событий каталога)
+        int fd = -1;
+        int watch = -1;      // Наблюдение за самим файлом
+        off_t offset = 0;    // Прочитано байт от начала файла
+        dev_t device = 0;
+        ino_t inode = 0;
+        std::string pending; // Начало записи без перевода строки
+    };
+
+    // Открытие файла по пути; at_end - начать с текущего конца
+    bool open_file(File& file, bool at_end);
+    // Дочитывание и закрытие (незавершенная запись передается целиком)
+    void close_file(File& file, const Callback& callback);
+    // Чтение новых данных до конца файла
+    void read_file(File& file, const Callback& callback);
+    // Проверка, не появился ли под именем файла другой файл (ротация)
+    void check_file(File& file, const Callback& callback);
+
+    int m_inotify = -1;
+    std::vector<File> m_files;
+    std::unordered_map<int, size_t> m_file_watches;             // Наблюдение -> файл
+    std::unordered_map<int, std::vector<size_t>> m_dir_watches; // Каталог -> файлы
+    std::vector<char> m_buffer;
+};
@@ -0,0 +1,232 @@
+#include "mapped_output.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+size_t page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+// Конец данных: последний ненулевой байт. Хвост из нулей остается
+// от выделенного, но не записанного сегмента (после аварии)
+uint64_t find_data_end(int fd, uint64_t file_size) {
+    vector<char> chunk(64 * 1024);
+    uint64_t end = file_size;
+    while (end > 0) {
+        size_t size = static_cast<size_t>(min<uint64_t>(chunk.size(), end));
+        ssize_t bytes = pread(fd, chunk.data(), size, end - size);
+        if (bytes != static_cast<ssize_t>(size)) {
+            throw runtime_error("Cannot read journal tail: " + string(strerror(errno)));
+        }
+        for (size_t i = size; i > 0; --i) {
+            if (chunk[i - 1] != 0) {
+                return end - size + i;
+            }
+        }
+        end -= size;
+    }
+    return 0;
+}
+
+} // namespace
+
+MappedFileOutput::MappedFileOutput(const string& filename, size_t segment_size)
+    : m_filename(filename) {
+    // Сегмент - целое число страниц
+    const size_t page = page_size();
+    m_segment_size = max(page, (segment_size + page - 1) / page * page);
+
+    bool file_exists = filesystem::exists(filename);
+    m_fd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        throw runtime_error("Cannot open file: " + filename);
+    }
+    struct stat info;
+    if (fstat(m_fd, &info) == -1) {
+        close(m_fd);
+        throw runtime_error("Cannot stat file: " + filename);
+    }
+
+    try {
+        // Первый сегмент начинается со страницы, содержащей конец данных
+        uint64_t data_end = find_data_end(m_fd, info.st_size);
+        m_current = map_segment(data_end - data_end % page, false);
+        m_used = data_end % page;
+    } catch (...) {
+        close(m_fd);
+        throw;
+    }
+
+    // BOM только в новом файле, как у FileOutput
+    if (!file_exists && m_used == 0 && m_current.offset == 0) {
+        append("\xEF\xBB\xBF", 3);
+    }
+
+    m_prepare_offset = m_current.offset + m_current.size;
+    m_prepare = true;
+    m_thread = thread(&MappedFileOutput::background, this);
+}
+
+MappedFileOutput::~MappedFileOutput() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    // Неиспользованный подготовленный сегмент и выделенный хвост отбрасываются
+    if (m_prepared.data) {
+        munmap(m_prepared.data, m_prepared.size);
+    }
+    munmap(m_current.data, m_current.size);
+    if (ftruncate(m_fd, m_current.offset + m_used) == -1) {
+        cerr << "Cannot truncate " << m_filename << ": " << strerror(errno) << endl;
+    }
+    close(m_fd);
+}
+
+MappedFileOutput::Segment MappedFileOutput::map_segment(uint64_t offset, bool populate) {
+    // Блоки выделяются заранее (размер файла увеличивается). Разреженный
+    // файл не годится: при нехватке места первая запись в отображение
+    // получила бы SIGBUS. posix_fallocate без поддержки fallocate в файловой
+    // системе выделяет блоки записью, ошибка сообщается здесь
+    int error = posix_fallocate(m_fd, offset, m_segment_size);
+    if (error != 0) {
+        throw runtime_error("Cannot allocate journal segment: " + string(strerror(error)));
+    }
+    int flags = MAP_SHARED | (populate ? MAP_POPULATE : 0);
+    void* data = mmap(nullptr, m_segment_size, PROT_READ | PROT_WRITE, flags, m_fd, offset);
+    if (data == MAP_FAILED) {
+        throw runtime_error("Cannot map journal segment: " + string(strerror(errno)));
+    }
+    return {static_cast<char*>(data), offset, m_segment_size};
+}
+
+void MappedFileOutput::write(const string& message) {
+    append(message.data(), message.size());
+    append("\n", 1);
+}
+
+void MappedFileOutput::append(const char* data, size_t size) {
+    // Запись может переходить через границу сегментов: файл непрерывен
+    while (size > 0) {
+        size_t chunk = min(size, m_current.size - m_used);
+        memcpy(m_current.data + m_used, data, chunk);
+        m_used += chunk;
+        data += chunk;
+        size -= chunk;
+        if (m_used == m_current.size) {
+            next_segment();
+        }
+    }
+}
+
+void MappedFileOutput::next_segment() {
+    const uint64_t next_offset = m_current.offset + m_current.size;
+    Segment next;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_prepared.data && m_prepared.offset == next_offset) {
+            next = m_prepared;
+            m_prepared = Segment();
+        }
+    }
+    // Фоновый поток не успел: сегмент готовится здесь (с системными вызовами).
+    // Если выделить не удалось, заполненный сегмент остается текущим:
+    // следующая запись повторит попытку
+    if (!next.data) {
+        next = map_segment(next_offset, false);
+    }
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_retired.push_back(m_current);
+        m_prepare_offset = next_offset + m_segment_size;
+        m_prepare = true;
+    }
+    m_current = next;
+    m_used = 0;
+    m_condition.notify_one();
+}
+
+void MappedFileOutput::background() {
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] {
+            return m_stop || !m_retired.empty() || m_prepare;
+        });
+
+        // Заполненные сегменты: сброс на диск и освобождение отображения
+        if (!m_retired.empty()) {
+            Segment segment = m_retired.back();
+            m_retired.pop_back();
+            m_busy = true;
+            lock.unlock();
+            if (msync(segment.data, segment.size, MS_SYNC) == -1) {
+                cerr << "msync failed for " << m_filename << ": " << strerror(errno) << endl;
+            }
+            munmap(segment.data, segment.size);
+            lock.lock();
+            m_busy = false;
+            if (m_retired.empty()) {
+                m_idle_condition.notify_all();
+            }
+            continue;
+        }
+
+        // Следующий сегмент: выделение места и заполнение таблиц страниц
+        // заранее, чтобы запись не ждала ни fallocate, ни обработки сбоев страниц
+        if (m_prepare && !m_stop) {
+            uint64_t offset = m_prepare_offset;
+            m_prepare = false;
+            Segment old = m_prepared;
+            m_prepared = Segment();
+            lock.unlock();
+            if (old.data) {
+                munmap(old.data, old.size);
+            }
+            Segment segment;
+            try {
+                segment = map_segment(offset, true);
+            } catch (const exception& e) {
+                cerr << "Journal segment error: " << e.what() << endl;
+            }
+            lock.lock();
+            m_prepared = segment;
+            continue;
+        }
+
+        if (m_stop) break;
+    }
+}
+
+bool MappedFileOutput::is_connected() const {
+    return m_fd != -1;
+}
+
+void MappedFileOutput::sync() {
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_idle_condition.wait(lock, [this] { return m_retired.empty() && !m_busy; });
+    }
+    size_t length = (m_used + page_size() - 1) / page_size() * page_size();
+    if (length > 0 && msync(m_current.data, length, MS_SYNC) == -1) {
+        throw runtime_error("msync failed: " + string(strerror(errno)));
+    }
+    if (fdatasync(m_fd) == -1) {
+        throw runtime_error("fdatasync failed: " + string(strerror(errno)));
+    }
+}
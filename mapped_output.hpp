@@ -0,0 +1,67 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Размер сегмента файла по умолчанию
+constexpr size_t MAPPED_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+// Вывод в файл через отображение в память. Файл растет сегментами:
+// место выделяется fallocate, сегмент отображается mmap, запись - memcpy
+// в отображение без системных вызовов. Фоновый поток заранее готовит
+// следующий сегмент, а заполненные сбрасывает (msync) и освобождает.
+// Пока вывод открыт, в конце файла есть выделенный хвост из нулей; при
+// закрытии файл усекается до данных, после аварии хвост отбрасывается
+// при следующем открытии. Запись в отображение не порождает событий
+// inotify, поэтому такой файл нельзя читать по мере записи (tail -F,
+// stats_collector --follow). Как и FileOutput, вызывается из одного потока
+class MappedFileOutput : public LogOutput {
+public:
+    explicit MappedFileOutput(const std::string& filename,
+                              size_t segment_size = MAPPED_SEGMENT_SIZE);
+    ~MappedFileOutput() override;
+
+    MappedFileOutput(const MappedFileOutput&) = delete;
+    MappedFileOutput& operator=(const MappedFileOutput&) = delete;
+
+    void write(const std::string& message) override;
+    bool is_connected() const override;
+    // Ожидание фонового сброса, msync текущего сегмента и fdatasync
+    void sync() override;
+
+private:
+    struct Segment {
+        char* data = nullptr;
+        uint64_t offset = 0; // Смещение в файле (кратно размеру страницы)
+        size_t size = 0;
+    };
+
+    // Выделение места и отображение сегмента с offset
+    Segment map_segment(uint64_t offset, bool populate);
+    void append(const char* data, size_t size);
+    // Переход к следующему сегменту (текущий заполнен)
+    void next_segment();
+    // Цикл фонового потока
+    void background();
+
+    std::string m_filename;
+    int m_fd = -1;
+    size_t m_segment_size;
+    Segment m_current;
+    size_t m_used = 0; // Занято в текущем сегменте
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;      // Работа для фонового потока
+    std::condition_variable m_idle_condition; // Заполненные сегменты сброшены
+    std::vector<Segment> m_retired;           // Ждут msync и munmap
+    Segment m_prepared;                       // Готовый следующий сегмент
+    uint64_t m_prepare_offset = 0;
+    bool m_prepare = false;                   // Нужно подготовить сегмент
+    bool m_busy = false;                      // Идет сброс сегмента
+    bool m_stop = false;
+};
@@ -0,0 +1,131 @@
+#include "record_scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RECORD_SCAN_X86 1
+#endif
+
+using namespace std;
+
+namespace {
+
+const char* find_byte_scalar(const char* begin, const char* end, char byte) {
+    const void* found = memchr(begin, byte, end - begin);
+    return found ? static_cast<const char*>(found) : end;
+}
+
+#ifdef RECORD_SCAN_X86
+
+// 16 байт за шаг: сравнение всех байтов блока и маска совпадений
+const char* find_byte_sse2(const char* begin, const char* end, char byte) {
+    const __m128i needle = _mm_set1_epi8(byte);
+    while (end - begin >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 16;
+    }
+    while (begin < end && *begin != byte) {
+        ++begin;
+    }
+    return begin;
+}
+
+// 64 байта за шаг (два 32-байтных блока), хвост - через SSE2
+__attribute__((target("avx2")))
+const char* find_byte_avx2(const char* begin, const char* end, char byte) {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    while (end - begin >= 64) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + 32));
+        uint32_t low = _mm256_movemask_epi8(_mm256_cmpeq_epi8(first, needle));
+        uint32_t high = _mm256_movemask_epi8(_mm256_cmpeq_epi8(second, needle));
+        if ((low | high) != 0) {
+            uint64_t mask = (static_cast<uint64_t>(high) << 32) | low;
+            return begin + __builtin_ctzll(mask);
+        }
+        begin += 64;
+    }
+    while (end - begin >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 32;
+    }
+    return find_byte_sse2(begin, end, byte);
+}
+
+#endif
+
+ScanImpl detect_scan_impl() {
+#ifdef RECORD_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return ScanImpl::AVX2;
+    if (__builtin_cpu_supports("sse2")) return ScanImpl::SSE2;
+#endif
+    return ScanImpl::SCALAR;
+}
+
+using FindByte = const char* (*)(const char*, const char*, char);
+
+FindByte resolve(ScanImpl impl) {
+#ifdef RECORD_SCAN_X86
+    if (impl == ScanImpl::AVX2 && best_scan_impl() == ScanImpl::AVX2) return find_byte_avx2;
+    if (impl != ScanImpl::SCALAR && best_scan_impl() != ScanImpl::SCALAR) return find_byte_sse2;
+#endif
+    (void)impl;
+    return find_byte_scalar;
+}
+
+// Выбор реализации один раз при загрузке
+const ScanImpl g_best_impl = detect_scan_impl();
+const FindByte g_find_byte = resolve(g_best_impl);
+
+// Тег уровня сразу за '[': 0 - LOW, 1 - MEDIUM, 2 - HIGH, -1 - не тег
+int match_level_tag(const char* tag, const char* end) {
+    const size_t left = end - tag;
+    if (left >= 4 && memcmp(tag, "LOW]", 4) == 0) return 0;
+    if (left >= 7 && memcmp(tag, "MEDIUM]", 7) == 0) return 1;
+    if (left >= 5 && memcmp(tag, "HIGH]", 5) == 0) return 2;
+    return -1;
+}
+
+} // namespace
+
+ScanImpl best_scan_impl() {
+    return g_best_impl;
+}
+
+const char* scan_impl_name(ScanImpl impl) {
+    switch (impl) {
+    case ScanImpl::AVX2: return "avx2";
+    case ScanImpl::SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+const char* find_byte(const char* begin, const char* end, char byte) {
+    return g_find_byte(begin, end, byte);
+}
+
+const char* find_byte(ScanImpl impl, const char* begin, const char* end, char byte) {
+    return resolve(impl)(begin, end, byte);
+}
+
+importances scan_importance(string_view text) {
+    const char* end = text.data() + text.size();
+    bool medium = false;
+    // Обычно тег стоит сразу за меткой времени, но "[LOW]" дальше по тексту
+    // по-прежнему имеет приоритет, поэтому просматриваются все '['
+    for (const char* open = g_find_byte(text.data(), end, '['); open != end;
+         open = g_find_byte(open + 1, end, '[')) {
+        int level = match_level_tag(open + 1, end);
+        if (level == 0) return importances::LOW;
+        if (level == 1) medium = true;
+    }
+    return medium ? importances::MEDIUM : importances::HIGH;
+}
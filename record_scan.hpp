@@ -0,0 +1,101 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+
+// Размер буфера приема и максимальная длина записи без перевода строки
+constexpr size_t RECV_BUFFER_SIZE = 256 * 1024;
+constexpr size_t MAX_RECORD_SIZE = 64 * 1024;
+
+// Реализация векторного поиска байта. Лучшая доступная выбирается
+// при запуске по возможностям процессора
+enum class ScanImpl { SCALAR, SSE2, AVX2 };
+
+ScanImpl best_scan_impl();
+const char* scan_impl_name(ScanImpl impl);
+
+// Первое вхождение byte в [begin, end) или end
+const char* find_byte(const char* begin, const char* end, char byte);
+// То же с явно заданной реализацией (для тестов и замеров);
+// недоступная на процессоре реализация заменяется скалярной
+const char* find_byte(ScanImpl impl, const char* begin, const char* end, char byte);
+
+// Уровень важности по тегу "[LOW]", "[MEDIUM]" или "[HIGH]" в тексте.
+// Один проход по '[' векторным поиском; правила как у прежнего поиска
+// подстрок: "[LOW]" где угодно - LOW, иначе "[MEDIUM]" - MEDIUM, иначе HIGH
+importances scan_importance(std::string_view text);
+
+// Буфер приема записей, разделенных переводом строки.
+// Данные читаются прямо в буфер, полные записи передаются как string_view
+// на память буфера без копирования; остаток переносится в начало
+class RecordBuffer {
+public:
+    explicit RecordBuffer(size_t capacity = RECV_BUFFER_SIZE) : m_data(capacity) {}
+
+    // Свободное место для чтения (recv/read)
+    char* space() { return m_data.data() + m_used; }
+    size_t space_size() const { return m_data.size() - m_used; }
+
+    // Учет прочитанных bytes байт: callback(string_view) для каждой
+    // полной непустой записи. Запись длиннее MAX_RECORD_SIZE без перевода
+    // строки передается целиком
+    template <typename Callback>
+    void commit(size_t bytes, Callback&& callback);
+
+    // Передача незавершенной записи (при отключении источника)
+    template <typename Callback>
+    void finish(Callback&& callback);
+
+    size_t pending() const { return m_used; }
+
+    // Один буфер может обслуживать несколько источников: незавершенная
+    // запись источника сохраняется между чтениями (емкость строки
+    // переиспользуется) и возвращается в буфер перед следующим чтением
+    void save_pending(std::string& out) {
+        out.assign(m_data.data(), m_used);
+        m_used = 0;
+    }
+    void load_pending(const std::string& saved) {
+        std::memcpy(m_data.data(), saved.data(), saved.size());
+        m_used = saved.size();
+    }
+
+private:
+    std::vector<char> m_data;
+    size_t m_used = 0;
+};
+
+template <typename Callback>
+void RecordBuffer::commit(size_t bytes, Callback&& callback) {
+    const char* begin = m_data.data();
+    const char* end = begin + m_used + bytes;
+    // Уже просмотренный остаток не содержит перевода строки
+    const char* scan = begin + m_used;
+    const char* line_start = begin;
+    while (true) {
+        const char* newline = find_byte(scan, end, '\n');
+        if (newline == end) break;
+        if (newline > line_start) {
+            callback(std::string_view(line_start, newline - line_start));
+        }
+        line_start = scan = newline + 1;
+    }
+
+    m_used = end - line_start;
+    if (m_used > MAX_RECORD_SIZE) {
+        callback(std::string_view(line_start, m_used));
+        m_used = 0;
+    } else if (line_start != begin) {
+        std::memmove(m_data.data(), line_start, m_used);
+    }
+}
+
+template <typename Callback>
+void RecordBuffer::finish(Callback&& callback) {
+    if (m_used > 0) {
+        callback(std::string_view(m_data.data(), m_used));
+        m_used = 0;
+    }
+}
@@ -0,0 +1,268 @@
+#include "rollup_store.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const char ROLLUP_MAGIC[4] = {'J', 'R', 'L', 'B'};
+// Наибольший размер строки в данных блока: 7 чисел varint по 10 байт
+constexpr uint64_t ROLLUP_ROW_MAX_BYTES = 7 * 10;
+
+void put_varint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool get_varint(const char*& pos, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*pos++);
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool read_varint(istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+void RollupRow::merge(const RollupRow& other) {
+    if (other.total() == 0) return;
+    min_len = total() == 0 ? other.min_len : min(min_len, other.min_len);
+    max_len = max(max_len, other.max_len);
+    low += other.low;
+    medium += other.medium;
+    high += other.high;
+    bytes += other.bytes;
+}
+
+// RollupWriter
+RollupWriter::RollupWriter(const string& filename, size_t block_rows)
+    : m_block_rows(clamp<size_t>(block_rows, 1, ROLLUP_BLOCK_ROWS)) {
+    m_file.open(filename, ios::app | ios::binary);
+    if (!m_file.is_open()) {
+        throw runtime_error("Cannot open rollup file: " + filename);
+    }
+    m_pending.reserve(m_block_rows);
+}
+
+RollupWriter::~RollupWriter() {
+    try {
+        flush();
+    } catch (...) {
+        // Ошибки записи при завершении игнорируются
+    }
+}
+
+void RollupWriter::add(time_t timestamp, importances importance, size_t length) {
+    int64_t minute = timestamp / 60;
+    if (m_has_current && minute < m_current.minute) {
+        minute = m_current.minute; // Часы сдвинулись назад - минуты в файле не убывают
+    }
+    if (m_has_current && minute != m_current.minute) {
+        // Началась новая минута - закрываем строку предыдущей
+        m_pending.push_back(m_current);
+        m_has_current = false;
+        if (m_pending.size() >= m_block_rows) {
+            write_block();
+        }
+    }
+    if (!m_has_current) {
+        m_current = RollupRow{};
+        m_current.minute = minute;
+        m_current.min_len = length;
+        m_has_current = true;
+    }
+
+    switch (importance) {
+        case importances::LOW:    m_current.low++;    break;
+        case importances::MEDIUM: m_current.medium++; break;
+        case importances::HIGH:   m_current.high++;   break;
+    }
+    m_current.bytes += length;
+    m_current.min_len = min<uint64_t>(m_current.min_len, length);
+    m_current.max_len = max<uint64_t>(m_current.max_len, length);
+}
+
+void RollupWriter::flush() {
+    if (m_has_current) {
+        m_pending.push_back(m_current);
+        m_has_current = false;
+    }
+    write_block();
+}
+
+void RollupWriter::write_block() {
+    if (m_pending.empty()) return;
+
+    // Данные по столбцам: минуты (разности), счетчики уровней, байты, длины
+    string payload;
+    payload.reserve(m_pending.size() * 12);
+    int64_t previous = m_pending.front().minute;
+    for (const RollupRow& row : m_pending) {
+        put_varint(payload, static_cast<uint64_t>(row.minute - previous));
+        previous = row.minute;
+    }
+    for (const RollupRow& row : m_pending) put_varint(payload, row.low);
+    for (const RollupRow& row : m_pending) put_varint(payload, row.medium);
+    for (const RollupRow& row : m_pending) put_varint(payload, row.high);
+    for (const RollupRow& row : m_pending) put_varint(payload, row.bytes);
+    for (const RollupRow& row : m_pending) put_varint(payload, row.min_len);
+    // Максимум хранится как разность с минимумом
+    for (const RollupRow& row : m_pending) put_varint(payload, row.max_len - row.min_len);
+
+    string header(ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC));
+    put_varint(header, m_pending.size());
+    put_varint(header, static_cast<uint64_t>(m_pending.front().minute));
+    put_varint(header, static_cast<uint64_t>(m_pending.back().minute - m_pending.front().minute));
+    put_varint(header, payload.size());
+
+    m_file.write(header.data(), header.size());
+    m_file.write(payload.data(), payload.size());
+    m_file.flush();
+    if (!m_file) {
+        throw runtime_error("Rollup write failed");
+    }
+    m_pending.clear();
+}
+
+vector<RollupRow> query_rollups(const string& filename, int64_t from_minute, int64_t to_minute) {
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open rollup file: " + filename);
+    }
+
+    file.seekg(0, ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    vector<RollupRow> rows;
+    string payload;
+    while (true) {
+        char magic[sizeof(ROLLUP_MAGIC)];
+        if (!file.read(magic, sizeof(magic))) break;
+        if (memcmp(magic, ROLLUP_MAGIC, sizeof(magic)) != 0) {
+            throw runtime_error("Corrupted rollup file: " + filename);
+        }
+
+        uint64_t count, first, span, size;
+        if (!read_varint(file, count) || !read_varint(file, first) ||
+            !read_varint(file, span) || !read_varint(file, size)) {
+            break; // Недописанный блок в конце файла
+        }
+        // Размеры из заголовка проверяются до выделения памяти: строка
+        // занимает не больше ROLLUP_ROW_MAX_BYTES
+        if (count == 0 || count > ROLLUP_BLOCK_ROWS || size > count * ROLLUP_ROW_MAX_BYTES) {
+            throw runtime_error("Corrupted rollup block in " + filename);
+        }
+        if (size > file_size - static_cast<uint64_t>(file.tellg())) {
+            break; // Данные блока не дописаны (обрыв при аварии)
+        }
+        const int64_t first_minute = static_cast<int64_t>(first);
+        const int64_t last_minute = first_minute + static_cast<int64_t>(span);
+
+        // Блок целиком вне диапазона - пропускаем без чтения данных
+        if (last_minute < from_minute || first_minute > to_minute) {
+            file.seekg(static_cast<streamoff>(size), ios::cur);
+            continue;
+        }
+
+        payload.resize(size);
+        if (!file.read(payload.data(), size)) break;
+
+        vector<RollupRow> block(count);
+        const char* pos = payload.data();
+        const char* end = pos + payload.size();
+        bool ok = true;
+        uint64_t value;
+        int64_t minute = first_minute;
+        for (RollupRow& row : block) {
+            ok = ok && get_varint(pos, end, value);
+            minute += static_cast<int64_t>(value);
+            row.minute = minute;
+        }
+        for (RollupRow& row : block) ok = ok && get_varint(pos, end, row.low);
+        for (RollupRow& row : block) ok = ok && get_varint(pos, end, row.medium);
+        for (RollupRow& row : block) ok = ok && get_varint(pos, end, row.high);
+        for (RollupRow& row : block) ok = ok && get_varint(pos, end, row.bytes);
+        for (RollupRow& row : block) ok = ok && get_varint(pos, end, row.min_len);
+        for (RollupRow& row : block) {
+            ok = ok && get_varint(pos, end, value);
+            row.max_len = row.min_len + value;
+        }
+        if (!ok) {
+            throw runtime_error("Corrupted rollup block in " + filename);
+        }
+
+        for (const RollupRow& row : block) {
+            if (row.minute >= from_minute && row.minute <= to_minute) {
+                rows.push_back(row);
+            }
+        }
+    }
+
+    // Блоки идут по времени, но после перезапуска минуты могут повторяться
+    stable_sort(rows.begin(), rows.end(),
+                [](const RollupRow& a, const RollupRow& b) { return a.minute < b.minute; });
+    vector<RollupRow> merged;
+    for (const RollupRow& row : rows) {
+        if (!merged.empty() && merged.back().minute == row.minute) {
+            merged.back().merge(row);
+        } else {
+            merged.push_back(row);
+        }
+    }
+    return merged;
+}
+
+void print_rollups(const vector<RollupRow>& rows, int64_t step, ostream& out) {
+    step = max<int64_t>(step, 1);
+
+    // Группировка по интервалам step минут
+    vector<RollupRow> groups;
+    for (const RollupRow& row : rows) {
+        int64_t bucket = row.minute - row.minute % step;
+        if (groups.empty() || groups.back().minute != bucket) {
+            RollupRow group;
+            group.minute = bucket;
+            groups.push_back(group);
+        }
+        groups.back().merge(row);
+    }
+
+    out << "Time              LOW     MEDIUM  HIGH    Bytes       Min   Max\n";
+    for (const RollupRow& row : groups) {
+        time_t timestamp = static_cast<time_t>(row.minute * 60);
+        tm time_info;
+        localtime_r(&timestamp, &time_info);
+        char time_buf[32];
+        strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M", &time_info);
+
+        char line[160];
+        snprintf(line, sizeof(line), "%-17s %-7llu %-7llu %-7llu %-11llu %-5llu %llu\n",
+                 time_buf,
+                 static_cast<unsigned long long>(row.low),
+                 static_cast<unsigned long long>(row.medium),
+                 static_cast<unsigned long long>(row.high),
+                 static_cast<unsigned long long>(row.bytes),
+                 static_cast<unsigned long long>(row.min_len),
+                 static_cast<unsigned long long>(row.max_len));
+        out << line;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <ctime>
+
+// Поминутный агрегат сообщений
+struct RollupRow {
+    int64_t minute = 0; // Номер минуты от начала эпохи (time / 60)
+    uint64_t low = 0;
+    uint64_t medium = 0;
+    uint64_t high = 0;
+    uint64_t bytes = 0;
+    uint64_t min_len = 0;
+    uint64_t max_len = 0;
+
+    uint64_t total() const { return low + medium + high; }
+    void merge(const RollupRow& other);
+};
+
+// Наибольшее число строк в блоке файла агрегатов (блок с большим числом
+// строк при чтении считается поврежденным)
+constexpr size_t ROLLUP_BLOCK_ROWS = 60;
+
+// Запись поминутных агрегатов в файл только на дозапись.
+// Файл состоит из блоков; в блоке строки хранятся по столбцам:
+//   "JRLB" | кол-во строк | первая минута | последняя минута | размер данных | данные
+// Все числа - varint, минуты внутри блока - разности с предыдущей строкой.
+// Заголовок позволяет пропускать блоки вне запрошенного диапазона без разбора
+class RollupWriter {
+public:
+    explicit RollupWriter(const std::string& filename, size_t block_rows = ROLLUP_BLOCK_ROWS);
+    ~RollupWriter();
+
+    RollupWriter(const RollupWriter&) = delete;
+    RollupWriter& operator=(const RollupWriter&) = delete;
+
+    // Учет одного сообщения
+    void add(time_t timestamp, importances importance, size_t length);
+    // Запись всех накопленных строк, включая текущую минуту
+    void flush();
+
+private:
+    void write_block();
+
+    std::ofstream m_file;
+    size_t m_block_rows;
+    RollupRow m_current;
+    bool m_has_current = false;
+    std::vector<RollupRow> m_pending;
+};
+
+// Чтение строк за диапазон минут [from_minute, to_minute].
+// Строки одной минуты (например, после перезапуска коллектора) объединяются
+std::vector<RollupRow> query_rollups(const std::string& filename,
+                                     int64_t from_minute, int64_t to_minute);
+
+// Вывод строк таблицей; step - ширина интервала группировки в минутах
+void print_rollups(const std::vector<RollupRow>& rows, int64_t step, 
+                   std::ostream& out = std::cout);
@@ -0,0 +1,364 @@
+#include "rotating_output.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <tuple>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#ifdef JOURNAL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const char BOM[] = "\xEF\xBB\xBF";
+constexpr size_t BOM_SIZE = 3;
+constexpr size_t COMPRESS_CHUNK = 256 * 1024;
+
+void write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            throw runtime_error("Journal write failed: " + string(strerror(errno)));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+// Фоновый поток не должен отнимать процессор и диск у приложения
+void lower_thread_priority() {
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+// Суффикс старого файла "ГГГГММДД-ЧЧММСС-N[.gz]": ключ сортировки
+// (время, номер) или false, если имя не относится к ротации
+bool parse_rotated_suffix(const string& suffix, string& stamp, uint64_t& number) {
+    if (suffix.size() < 17 || suffix[8] != '-' || suffix[15] != '-') return false;
+    for (size_t i = 0; i < 15; ++i) {
+        if (i != 8 && !isdigit(static_cast<unsigned char>(suffix[i]))) return false;
+    }
+    size_t end = suffix.size();
+    if (end > 3 && suffix.compare(end - 3, 3, ".gz") == 0) {
+        end -= 3;
+    }
+    if (end <= 16) return false;
+    number = 0;
+    for (size_t i = 16; i < end; ++i) {
+        if (!isdigit(static_cast<unsigned char>(suffix[i]))) return false;
+        number = number * 10 + (suffix[i] - '0');
+    }
+    stamp = suffix.substr(0, 15);
+    return true;
+}
+
+} // namespace
+
+RotatingFileOutput::RotatingFileOutput(const string& filename, const RotationPolicy& policy)
+    : m_filename(filename), m_policy(policy) {
+    filesystem::path path(filename);
+    m_next_path = (path.parent_path() / ("." + path.filename().string() + ".next")).string();
+    m_sync_path = m_next_path + "-sync";
+    // Остатки прошлого запуска
+    filesystem::remove(m_next_path);
+    filesystem::remove(m_sync_path);
+
+    bool file_exists = filesystem::exists(filename);
+    m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        throw runtime_error("Cannot open file: " + filename);
+    }
+    struct stat info;
+    if (fstat(m_fd, &info) == -1) {
+        int error = errno;
+        close(m_fd);
+        throw runtime_error("Cannot stat " + filename + ": " + strerror(error));
+    }
+    m_size = info.st_size;
+    // BOM только в новом файле, как у FileOutput
+    if (!file_exists && m_size == 0) {
+        write_all(m_fd, BOM, BOM_SIZE);
+        m_size = BOM_SIZE;
+    }
+    m_opened = chrono::steady_clock::now();
+
+    m_prepare = true;
+    m_thread = thread(&RotatingFileOutput::background, this);
+}
+
+RotatingFileOutput::~RotatingFileOutput() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join(); // Накопленные задания (сжатие) завершаются
+    }
+    if (m_next_fd != -1) {
+        close(m_next_fd);
+        unlink(m_next_path.c_str());
+    }
+    close(m_fd);
+}
+
+int RotatingFileOutput::create_file(const string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw runtime_error("Cannot create " + path + ": " + strerror(errno));
+    }
+    write_all(fd, BOM, BOM_SIZE);
+    return fd;
+}
+
+void RotatingFileOutput::write(const string& message) {
+    // Запись и перевод строки одним вызовом
+    char newline = '\n';
+    iovec parts[2] = {
+        {const_cast<char*>(message.data()), message.size()},
+        {&newline, 1}
+    };
+    iovec* part = parts;
+    int count = 2;
+    size_t remaining = message.size() + 1;
+    while (remaining > 0) {
+        ssize_t written = writev(m_fd, part, count);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            throw runtime_error("Journal write failed: " + string(strerror(errno)));
+        }
+        remaining -= written;
+        while (written > 0 && count > 0) {
+            size_t chunk = min<size_t>(written, part->iov_len);
+            part->iov_base = static_cast<char*>(part->iov_base) + chunk;
+            part->iov_len -= chunk;
+            written -= chunk;
+            if (part->iov_len == 0) {
+                part++;
+                count--;
+            }
+        }
+    }
+    m_size += message.size() + 1;
+
+    // Время проверяется при записи: простаивающий файл не ротируется
+    if ((m_policy.max_bytes > 0 && m_size >= m_policy.max_bytes) ||
+        (m_policy.max_age.count() > 0 &&
+         chrono::steady_clock::now() - m_opened >= m_policy.max_age)) {
+        rotate();
+    }
+}
+
+void RotatingFileOutput::rotate() {
+    // Готовый файл переименовывается под блокировкой: фоновый поток не
+    // начнет создавать следующий под тем же именем, пока оно занято
+    unique_lock<mutex> lock(m_mutex);
+    int next_fd = m_next_fd;
+    m_next_fd = -1;
+    string next_path = m_next_path;
+    if (next_fd == -1) {
+        // Фоновый поток не успел (частая ротация) и, возможно, как раз
+        // создает m_next_path: новый файл создается под другим именем
+        lock.unlock();
+        next_path = m_sync_path;
+        next_fd = create_file(next_path);
+    }
+
+    // Имя старого файла; номер делает имена в пределах секунды уникальными
+    char stamp[32];
+    time_t now = time(nullptr);
+    tm local;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    string rotated;
+    while (true) {
+        rotated = m_filename + "." + stamp + "-" + to_string(m_rotation++);
+        // Сжатый файл прошлого запуска с тем же именем затерло бы сжатие
+        struct stat existing;
+        if (m_policy.compress && lstat((rotated + ".gz").c_str(), &existing) == 0) continue;
+        // Старое содержимое получает второе имя, затем новый файл атомарно
+        // занимает имя журнала: filename существует в любой момент
+        if (link(m_filename.c_str(), rotated.c_str()) == 0) break;
+        if (errno == EEXIST) continue;
+        // Файловая система без жестких ссылок: короткий разрыв между
+        // rename. Обычный rename молча заменил бы существующий файл
+        if (renameat2(AT_FDCWD, m_filename.c_str(), AT_FDCWD, rotated.c_str(),
+                      RENAME_NOREPLACE) == 0) break;
+        if (errno == EEXIST) continue;
+        if (errno == EINVAL) {
+            // RENAME_NOREPLACE не поддерживается: имя проверяется заранее
+            if (lstat(rotated.c_str(), &existing) == 0) continue;
+            if (rename(m_filename.c_str(), rotated.c_str()) == 0) break;
+        }
+        close(next_fd);
+        throw runtime_error("Cannot rotate " + m_filename + ": " + strerror(errno));
+    }
+    if (rename(next_path.c_str(), m_filename.c_str()) == -1) {
+        close(next_fd);
+        throw runtime_error("Cannot rotate " + m_filename + ": " + strerror(errno));
+    }
+
+    int old_fd = m_fd;
+    m_fd = next_fd;
+    m_size = BOM_SIZE;
+    m_opened = chrono::steady_clock::now();
+    if (!lock.owns_lock()) {
+        lock.lock();
+    }
+    m_jobs.push_back({old_fd, move(rotated)});
+    m_prepare = true;
+    lock.unlock();
+    m_condition.notify_one();
+}
+
+void RotatingFileOutput::background() {
+    lower_thread_priority();
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] {
+            return m_stop || !m_jobs.empty() || (m_prepare && m_next_fd == -1);
+        });
+
+        // Сначала файл для следующей ротации: его ждет поток записи
+        if (m_prepare && m_next_fd == -1 && !m_stop) {
+            m_prepare = false;
+            lock.unlock();
+            int fd = -1;
+            try {
+                fd = create_file(m_next_path);
+            } catch (const exception& e) {
+                cerr << "Rotation error: " << e.what() << endl;
+            }
+            lock.lock();
+            m_next_fd = fd;
+            continue;
+        }
+        m_prepare = false;
+
+        if (!m_jobs.empty()) {
+            Job job = move(m_jobs.front());
+            m_jobs.erase(m_jobs.begin());
+            lock.unlock();
+            close(job.fd);
+            if (m_policy.compress) {
+                compress_file(job.rotated);
+            }
+            apply_retention();
+            lock.lock();
+            continue;
+        }
+
+        if (m_stop) break;
+    }
+}
+
+void RotatingFileOutput::compress_file(const string& rotated) {
+#ifdef JOURNAL_HAVE_ZLIB
+    const string target = rotated + ".gz";
+    const string temp = target + ".tmp";
+    int in = open(rotated.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in == -1 && errno == ENOENT) {
+        return; // Уже удален по retention, пока ждал в очереди
+    }
+    gzFile out = in == -1 ? nullptr : gzopen(temp.c_str(), "wb6");
+    bool ok = out != nullptr;
+    vector<char> buffer(ok ? COMPRESS_CHUNK : 0);
+    while (ok) {
+        ssize_t bytes = read(in, buffer.data(), buffer.size());
+        if (bytes == -1 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            ok = bytes == 0;
+            break;
+        }
+        ok = gzwrite(out, buffer.data(), static_cast<unsigned>(bytes)) == bytes;
+    }
+    if (out != nullptr && gzclose(out) != Z_OK) {
+        ok = false;
+    }
+    if (in != -1) {
+        close(in);
+    }
+    // Исходный файл удаляется, только когда сжатый записан целиком
+    if (ok && rename(temp.c_str(), target.c_str()) == 0) {
+        unlink(rotated.c_str());
+    } else {
+        cerr << "Cannot compress " << rotated << ", kept uncompressed" << endl;
+        unlink(temp.c_str());
+    }
+#else
+    (void)rotated; // Сборка без zlib: старые файлы не сжимаются
+#endif
+}
+
+void RotatingFileOutput::apply_retention() {
+    if (m_policy.retention == 0) return;
+    vector<string> files = rotated_files(m_filename);
+    for (size_t i = 0; i + m_policy.retention < files.size(); ++i) {
+        // Работает в фоновом потоке: ошибка не должна завершать программу
+        error_code error;
+        filesystem::remove(files[i], error);
+        if (error) {
+            cerr << "Cannot remove " << files[i] << ": " << error.message() << endl;
+        }
+    }
+}
+
+vector<string> RotatingFileOutput::rotated_files(const string& filename) {
+    filesystem::path path(filename);
+    filesystem::path directory = path.parent_path().empty() ? "." : path.parent_path();
+    const string prefix = path.filename().string() + ".";
+
+    vector<tuple<string, uint64_t, string>> found;
+    error_code error;
+    filesystem::directory_iterator it(directory, error);
+    for (; !error && it != filesystem::directory_iterator(); it.increment(error)) {
+        string name = it->path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) != 0) continue;
+        string stamp;
+        uint64_t number;
+        if (parse_rotated_suffix(name.substr(prefix.size()), stamp, number)) {
+            found.emplace_back(stamp, number, (path.parent_path() / name).string());
+        }
+    }
+    if (error) {
+        // Неполный список не годится для retention: удалились бы не самые старые
+        cerr << "Cannot list " << directory.string() << ": " << error.message() << endl;
+        return {};
+    }
+    sort(found.begin(), found.end());
+
+    vector<string> files;
+    for (auto& item : found) {
+        files.push_back(move(get<2>(item)));
+    }
+    return files;
+}
+
+bool RotatingFileOutput::is_connected() const {
+    return m_fd != -1;
+}
+
+void RotatingFileOutput::sync() {
+    if (fsync(m_fd) == -1) {
+        throw runtime_error("fsync failed: " + string(strerror(errno)));
+    }
+}
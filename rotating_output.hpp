@@ -0,0 +1,75 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+// Условия ротации и хранение старых файлов
+struct RotationPolicy {
+    uint64_t max_bytes = 0;             // Размер файла для ротации (0 - без ограничения)
+    std::chrono::seconds max_age{0};    // Время жизни файла (0 - без ограничения)
+    size_t retention = 7;               // Сколько старых файлов хранить (0 - все)
+    bool compress = true;               // Сжимать старые файлы в .gz (если есть zlib)
+};
+
+// Вывод в файл с ротацией по размеру или времени.
+// Старый файл получает имя "<filename>.<ГГГГММДД-ЧЧММСС>-<N>" (hard link),
+// на место filename атомарно (rename) встает заранее созданный новый
+// файл, поэтому filename существует всегда. Поток записи выполняет только
+// эти две операции с каталогом; закрытие старого файла, сжатие и удаление
+// файлов сверх retention выполняет фоновый поток с низким приоритетом.
+// Как и FileOutput, вызывается из одного потока
+class RotatingFileOutput : public LogOutput {
+public:
+    RotatingFileOutput(const std::string& filename, const RotationPolicy& policy);
+    ~RotatingFileOutput() override;
+
+    RotatingFileOutput(const RotatingFileOutput&) = delete;
+    RotatingFileOutput& operator=(const RotatingFileOutput&) = delete;
+
+    void write(const std::string& message) override;
+    bool is_connected() const override;
+    void sync() override;
+
+    // Ротация независимо от условий
+    void rotate();
+
+    // Старые файлы журнала (сжатые и нет) от старых к новым;
+    // пусто, если каталог не удалось прочитать
+    static std::vector<std::string> rotated_files(const std::string& filename);
+
+private:
+    // Новый файл журнала с BOM (следующий создается фоновым потоком заранее)
+    int create_file(const std::string& path);
+    // Цикл фонового потока
+    void background();
+    // Сжатие rotated в rotated.gz и удаление файлов сверх retention
+    void compress_file(const std::string& rotated);
+    void apply_retention();
+
+    std::string m_filename;
+    std::string m_next_path;      // Заранее созданный файл (скрытый, рядом с журналом)
+    std::string m_sync_path;      // Файл, созданный потоком записи, если m_next_path не готов
+    RotationPolicy m_policy;
+    int m_fd = -1;
+    uint64_t m_size = 0;
+    std::chrono::steady_clock::time_point m_opened;
+    uint64_t m_rotation = 0;      // Номер ротации (для уникальности имен)
+
+    // Работа фонового потока (под m_mutex)
+    struct Job {
+        int fd;                   // Старый дескриптор для закрытия
+        std::string rotated;      // Старый файл
+    };
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<Job> m_jobs;
+    int m_next_fd = -1;           // Готовый файл или -1
+    bool m_prepare = false;
+    bool m_stop = false;
+};
@@ -0,0 +1,256 @@
+#include "sharded_output.hpp"
+#include <atomic>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+atomic<uint64_t> g_next_output_id{1};
+
+// Кэш сегментов потока: (экземпляр вывода, источник) -> сегмент. Обычно
+// поток пишет в один-два вывода от своего имени, поэтому достаточно
+// короткого списка; поток записи LogManager с множеством источников
+// находит остальные сегменты под мьютексом
+struct ShardCacheEntry {
+    uint64_t owner;
+    uint32_t producer;
+    void* shard;
+};
+thread_local vector<ShardCacheEntry> t_shard_cache;
+constexpr size_t SHARD_CACHE_LIMIT = 16;
+
+int64_t realtime_ns() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void append_number(string& out, uint64_t value) {
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+// Время и номер последней строки существующего сегмента. false - сегмент
+// пуст или последняя строка без префикса (оборвана при аварии)
+bool read_last_prefix(int fd, int64_t& time_ns, uint64_t& sequence) {
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size == 0) {
+        return false;
+    }
+    // Начало последней строки: перевод строки ищется с конца блоками,
+    // завершающий перевод строки самой строки пропускается
+    off_t end = info.st_size - 1;
+    off_t line_start = 0;
+    char chunk[4096];
+    while (end > 0) {
+        off_t begin = max<off_t>(0, end - static_cast<off_t>(sizeof(chunk)));
+        ssize_t bytes = pread(fd, chunk, end - begin, begin);
+        if (bytes != end - begin) {
+            return false;
+        }
+        const void* newline = memrchr(chunk, '\n', bytes);
+        if (newline) {
+            line_start = begin + (static_cast<const char*>(newline) - chunk) + 1;
+            break;
+        }
+        end = begin;
+    }
+
+    char prefix[48];
+    ssize_t bytes = pread(fd, prefix, sizeof(prefix), line_start);
+    if (bytes <= 0) {
+        return false;
+    }
+    const char* last = prefix + bytes;
+    auto time_end = from_chars(prefix, last, time_ns);
+    if (time_end.ec != errc() || time_end.ptr == last || *time_end.ptr != ' ') {
+        return false;
+    }
+    auto sequence_end = from_chars(time_end.ptr + 1, last, sequence);
+    return sequence_end.ec == errc() && sequence_end.ptr < last && *sequence_end.ptr == ' ';
+}
+
+} // namespace
+
+ShardedFileOutput::ShardedFileOutput(const string& base)
+    : m_base(base), m_id(g_next_output_id++) {}
+
+ShardedFileOutput::~ShardedFileOutput() {
+    for (auto& shard : m_shards) {
+        if (shard->fd != -1) {
+            close(shard->fd);
+        }
+    }
+}
+
+ShardedFileOutput::Shard& ShardedFileOutput::local_shard() {
+    const uint32_t producer = current_log_producer();
+    for (const ShardCacheEntry& entry : t_shard_cache) {
+        if (entry.owner == m_id && entry.producer == producer) {
+            return *static_cast<Shard*>(entry.shard);
+        }
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    Shard*& slot = m_by_producer[producer];
+    if (!slot) {
+        // Первая запись источника: новый сегмент
+        string path = m_base + ".shard-" + to_string(m_shards.size());
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            m_by_producer.erase(producer);
+            throw runtime_error("Cannot open shard " + path + ": " + strerror(errno));
+        }
+        m_shards.push_back(make_unique<Shard>());
+        Shard& shard = *m_shards.back();
+        shard.fd = fd;
+        shard.line.reserve(256);
+        // Сегмент прошлого запуска: номера и время продолжаются, иначе
+        // слияние перемешало бы записи двух запусков
+        int64_t last_ns;
+        uint64_t last_sequence;
+        if (read_last_prefix(fd, last_ns, last_sequence)) {
+            shard.last_ns = last_ns;
+            shard.sequence = last_sequence + 1;
+        }
+        slot = &shard;
+    }
+
+    if (t_shard_cache.size() >= SHARD_CACHE_LIMIT) {
+        t_shard_cache.clear(); // Записи удаленных выводов и источников больше не нужны
+    }
+    t_shard_cache.push_back({m_id, producer, slot});
+    return *slot;
+}
+
+void ShardedFileOutput::write(const string& message) {
+    Shard& shard = local_shard();
+
+    // Время в сегменте не убывает, даже если системные часы перевели назад
+    shard.last_ns = max(shard.last_ns, realtime_ns());
+    shard.line.clear();
+    append_number(shard.line, static_cast<uint64_t>(shard.last_ns));
+    shard.line += ' ';
+    append_number(shard.line, shard.sequence++);
+    shard.line += ' ';
+    shard.line += message;
+    shard.line += '\n';
+
+    // Один вызов write на запись; O_APPEND, поэтому строки не перемешиваются
+    size_t offset = 0;
+    while (offset < shard.line.size()) {
+        ssize_t written = ::write(shard.fd, shard.line.data() + offset, shard.line.size() - offset);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            throw runtime_error("Shard write failed: " + string(strerror(errno)));
+        }
+        offset += written;
+    }
+}
+
+bool ShardedFileOutput::is_connected() const {
+    return true;
+}
+
+void ShardedFileOutput::sync() {
+    lock_guard<mutex> lock(m_mutex);
+    for (auto& shard : m_shards) {
+        if (fsync(shard->fd) == -1) {
+            throw runtime_error("Shard fsync failed: " + string(strerror(errno)));
+        }
+    }
+}
+
+size_t ShardedFileOutput::shard_count() {
+    lock_guard<mutex> lock(m_mutex);
+    return m_shards.size();
+}
+
+vector<string> find_journal_shards(const string& base) {
+    vector<string> shards;
+    for (size_t index = 0;; ++index) {
+        string path = base + ".shard-" + to_string(index);
+        if (!filesystem::exists(path)) break;
+        shards.push_back(move(path));
+    }
+    return shards;
+}
+
+size_t merge_journal_shards(const vector<string>& shards, ostream& out) {
+    // Текущая строка каждого сегмента; в очереди - сегмент с наименьшим ключом
+    struct Cursor {
+        ifstream file;
+        vector<char> buffer;
+        string line;
+        int64_t time_ns = 0;
+        uint64_t sequence = 0;
+        size_t text = 0; // Начало записи в line
+    };
+    vector<Cursor> cursors(shards.size());
+
+    // Чтение следующей строки и разбор префикса. Строка без префикса
+    // получает время предыдущей строки сегмента
+    auto advance = [](Cursor& cursor) {
+        while (getline(cursor.file, cursor.line)) {
+            if (cursor.line.empty()) continue;
+            const char* begin = cursor.line.data();
+            const char* end = begin + cursor.line.size();
+            int64_t time_ns;
+            uint64_t sequence;
+            auto time_end = from_chars(begin, end, time_ns);
+            if (time_end.ec == errc() && time_end.ptr < end && *time_end.ptr == ' ') {
+                auto sequence_end = from_chars(time_end.ptr + 1, end, sequence);
+                if (sequence_end.ec == errc() && sequence_end.ptr < end && *sequence_end.ptr == ' ') {
+                    cursor.time_ns = time_ns;
+                    cursor.sequence = sequence;
+                    cursor.text = sequence_end.ptr + 1 - begin;
+                    return true;
+                }
+            }
+            cursor.text = 0;
+            return true;
+        }
+        return false;
+    };
+
+    using Key = tuple<int64_t, uint64_t, size_t>; // Время, номер, сегмент
+    priority_queue<Key, vector<Key>, greater<Key>> heads;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        Cursor& cursor = cursors[i];
+        cursor.buffer.resize(1 << 16);
+        cursor.file.rdbuf()->pubsetbuf(cursor.buffer.data(), cursor.buffer.size());
+        cursor.file.open(shards[i], ios::binary);
+        if (!cursor.file) {
+            throw runtime_error("Cannot open shard: " + shards[i]);
+        }
+        if (advance(cursor)) {
+            heads.emplace(cursor.time_ns, cursor.sequence, i);
+        }
+    }
+
+    size_t count = 0;
+    while (!heads.empty()) {
+        size_t index = get<2>(heads.top());
+        heads.pop();
+        Cursor& cursor = cursors[index];
+        out.write(cursor.line.data() + cursor.text, cursor.line.size() - cursor.text);
+        out.put('\n');
+        count++;
+        if (advance(cursor)) {
+            heads.emplace(cursor.time_ns, cursor.sequence, index);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <ostream>
+#include <cstdint>
+
+// Вывод журнала в отдельный файл для каждого источника записей
+// (current_log_producer): при прямой записи - для каждого пишущего потока,
+// через LogManager - для каждого потока, вызывающего log. Источник пишет
+// в свой сегмент "<base>.shard-<N>" без блокировок: общий мьютекс
+// берется только при первой записи источника, когда для него создается
+// сегмент. Строка сегмента - "<время нс> <номер> <запись>", время в
+// сегменте не убывает, номер растет внутри сегмента, в том числе между
+// запусками (сегменты дописываются). Общий упорядоченный журнал собирает
+// merge_journal_shards (journal_merge).
+// Экземпляр используется либо напрямую, либо через LogManager, но не
+// одновременно: иначе у одного источника было бы два пишущих потока.
+// journal_app принимает записи в одном потоке, поэтому сегменты ему
+// ничего не дают - вывод предназначен для многопоточных приложений
+class ShardedFileOutput : public LogOutput {
+public:
+    explicit ShardedFileOutput(const std::string& base);
+    ~ShardedFileOutput() override;
+
+    void write(const std::string& message) override;
+    bool is_connected() const override;
+    void sync() override; // fsync всех сегментов
+
+    size_t shard_count();
+
+private:
+    struct Shard {
+        int fd = -1;
+        uint64_t sequence = 0;
+        int64_t last_ns = 0;
+        std::string line; // Переиспользуемый буфер строки
+    };
+
+    // Сегмент текущего источника (создается при первой записи)
+    Shard& local_shard();
+
+    std::string m_base;
+    uint64_t m_id; // Уникален среди всех экземпляров (адрес может повториться)
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::unordered_map<uint32_t, Shard*> m_by_producer;
+};
+
+// Сегменты "<base>.shard-<N>" по возрастанию N
+std::vector<std::string> find_journal_shards(const std::string& base);
+
+// Потоковое k-путевое слияние сегментов по времени и номеру в один журнал
+// (записи без префикса сегмента). Возвращает число записей
+size_t merge_journal_shards(const std::vector<std::string>& shards, std::ostream& out);
@@ -0,0 +1,384 @@
+#include "shm_ring.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t SHM_RING_MAGIC = 0x4A524E32; // "JRN2"
+constexpr uint32_t RECORD_COMMITTED = 0x80000000u;
+constexpr uint32_t RECORD_PAD = 0x40000000u;
+constexpr uint32_t RECORD_LENGTH_MASK = 0x3FFFFFFFu;
+constexpr size_t RECORD_HEADER = sizeof(uint32_t);
+constexpr size_t RECORD_ALIGN = 8;
+
+size_t align_up(size_t value) {
+    return (value + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+uint32_t* record_word(char* data, size_t offset) {
+    return reinterpret_cast<uint32_t*>(data + offset);
+}
+
+long futex(uint32_t* address, int op, uint32_t value, const timespec* timeout) {
+    return syscall(SYS_futex, address, op, value, timeout, nullptr, 0);
+}
+
+// Ожидание места писателем: короткими интервалами, чтобы замечать уход читателя
+constexpr long WRITER_WAIT_NS = 50 * 1000000L;
+// Интервал повторного подключения ShmRingOutput
+constexpr auto RECONNECT_INTERVAL = chrono::seconds(1);
+
+} // namespace
+
+// Заголовок сегмента. Позиции растут монотонно, смещение в кольце -
+// позиция по модулю capacity. Поля читателя и писателей в разных
+// кэш-линиях, чтобы не мешать друг другу
+struct ShmRing::Header {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t capacity;
+    alignas(64) uint64_t write_pos;      // Зарезервировано писателями
+    alignas(64) uint64_t read_pos;       // Освобождено читателем
+    alignas(64) uint32_t reader_waiting; // Читатель спит или собирается заснуть
+    uint32_t wake_seq;                   // Слово futex для пробуждения
+    alignas(64) uint32_t writers_waiting; // Писателей ждут места
+    uint32_t space_seq;                   // Слово futex для пробуждения писателей
+    uint32_t reader_pid;                  // Процесс читателя
+    uint32_t closed;                      // Читатель ушел или сегмент пересоздан
+};
+
+namespace {
+
+// Отметка о закрытии сегмента и пробуждение ждущих писателей
+void close_header(ShmRing::Header* header) {
+    __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&header->space_seq, 1, __ATOMIC_RELEASE);
+    futex(&header->space_seq, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+// Закрытие сегмента, который будет пересоздан: подключенные к нему
+// писатели иначе продолжали бы писать в кольцо без читателя
+void close_existing(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) return;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(ShmRing::Header)) {
+        void* mapping = mmap(nullptr, sizeof(ShmRing::Header), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            auto* header = static_cast<ShmRing::Header*>(mapping);
+            if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == SHM_RING_MAGIC) {
+                close_header(header);
+            }
+            munmap(mapping, sizeof(ShmRing::Header));
+        }
+    }
+    close(fd);
+}
+
+} // namespace
+
+ShmRing ShmRing::create(const string& name, size_t capacity) {
+    if (capacity < 4096 || (capacity & (capacity - 1)) != 0) {
+        throw invalid_argument("Shared memory ring capacity must be a power of two >= 4096");
+    }
+
+    close_existing(name);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        throw runtime_error("shm_open failed for " + name + ": " + strerror(errno));
+    }
+
+    const size_t data_offset = align_up(sizeof(Header) + 63) & ~size_t(63);
+    const size_t mapping_size = data_offset + capacity;
+    if (ftruncate(fd, static_cast<off_t>(mapping_size)) == -1) {
+        string error = strerror(errno);
+        close(fd);
+        shm_unlink(name.c_str());
+        throw runtime_error("ftruncate failed for " + name + ": " + error);
+    }
+
+    void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw runtime_error("mmap failed for " + name + ": " + strerror(errno));
+    }
+
+    ShmRing ring;
+    ring.m_name = name;
+    ring.m_header = static_cast<Header*>(mapping);
+    ring.m_data = static_cast<char*>(mapping) + data_offset;
+    ring.m_capacity = capacity;
+    ring.m_mapping_size = mapping_size;
+    ring.m_reader = true;
+
+    // Новый сегмент заполнен нулями; magic публикуется последним
+    ring.m_header->capacity = capacity;
+    ring.m_header->reader_pid = static_cast<uint32_t>(getpid());
+    __atomic_store_n(&ring.m_header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return ring;
+}
+
+ShmRing ShmRing::open(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        throw runtime_error("shm_open failed for " + name + ": " + strerror(errno));
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+        close(fd);
+        throw runtime_error("Invalid shared memory ring: " + name);
+    }
+
+    const size_t mapping_size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw runtime_error("mmap failed for " + name + ": " + strerror(errno));
+    }
+
+    Header* header = static_cast<Header*>(mapping);
+    const size_t data_offset = align_up(sizeof(Header) + 63) & ~size_t(63);
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+        header->capacity + data_offset != mapping_size) {
+        munmap(mapping, mapping_size);
+        throw runtime_error("Invalid shared memory ring: " + name);
+    }
+
+    ShmRing ring;
+    ring.m_name = name;
+    ring.m_header = header;
+    ring.m_mapping_size = mapping_size;
+    ring.m_data = static_cast<char*>(mapping) + data_offset;
+    ring.m_capacity = header->capacity;
+    return ring;
+}
+
+ShmRing::ShmRing(ShmRing&& other) noexcept {
+    *this = move(other);
+}
+
+ShmRing& ShmRing::operator=(ShmRing&& other) noexcept {
+    if (this != &other) {
+        if (m_header) {
+            if (m_reader) {
+                close_header(m_header);
+            }
+            munmap(m_header, m_mapping_size);
+        }
+        m_name = move(other.m_name);
+        m_header = other.m_header;
+        m_data = other.m_data;
+        m_capacity = other.m_capacity;
+        m_mapping_size = other.m_mapping_size;
+        m_reader = other.m_reader;
+        other.m_header = nullptr;
+        other.m_data = nullptr;
+        other.m_reader = false;
+    }
+    return *this;
+}
+
+ShmRing::~ShmRing() {
+    if (m_header) {
+        if (m_reader) {
+            close_header(m_header);
+        }
+        munmap(m_header, m_mapping_size);
+    }
+}
+
+bool ShmRing::reader_alive() const {
+    if (__atomic_load_n(&m_header->closed, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    // Читатель мог завершиться аварийно, не отметив сегмент
+    pid_t pid = static_cast<pid_t>(m_header->reader_pid);
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+bool ShmRing::push(string_view record, int timeout_ms) {
+    const size_t size = align_up(RECORD_HEADER + record.size());
+    if (record.size() > RECORD_LENGTH_MASK || size > m_capacity / 2) {
+        throw runtime_error("Record too large for shared memory ring");
+    }
+
+    // Резервирование места. Если запись не помещается до конца кольца,
+    // остаток заполняется записью-заполнителем
+    if (__atomic_load_n(&m_header->closed, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    uint64_t pos = __atomic_load_n(&m_header->write_pos, __ATOMIC_RELAXED);
+    size_t offset, pad;
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while (true) {
+        offset = pos & (m_capacity - 1);
+        pad = offset + size > m_capacity ? m_capacity - offset : 0;
+        uint64_t read_pos = __atomic_load_n(&m_header->read_pos, __ATOMIC_ACQUIRE);
+        if (pos + pad + size - read_pos > m_capacity) {
+            // Кольцо заполнено - ждем, пока читатель освободит место.
+            // Без читателя места не будет: запись не добавляется
+            if (!reader_alive()) {
+                return false;
+            }
+            if (chrono::steady_clock::now() > deadline) {
+                throw runtime_error("Shared memory ring is full");
+            }
+            const uint32_t seq = __atomic_load_n(&m_header->space_seq, __ATOMIC_ACQUIRE);
+            __atomic_fetch_add(&m_header->writers_waiting, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            // Повторная проверка после объявления об ожидании (как в wait)
+            read_pos = __atomic_load_n(&m_header->read_pos, __ATOMIC_ACQUIRE);
+            if (pos + pad + size - read_pos > m_capacity) {
+                timespec timeout{0, WRITER_WAIT_NS};
+                futex(&m_header->space_seq, FUTEX_WAIT, seq, &timeout);
+            }
+            __atomic_fetch_sub(&m_header->writers_waiting, 1, __ATOMIC_RELAXED);
+            pos = __atomic_load_n(&m_header->write_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&m_header->write_pos, &pos, pos + pad + size,
+                                        true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (pad > 0) {
+        __atomic_store_n(record_word(m_data, offset), 
+                         RECORD_COMMITTED | RECORD_PAD | static_cast<uint32_t>(pad),
+                         __ATOMIC_RELEASE);
+        offset = 0;
+    }
+
+    // Копирование на место и публикация длины
+    memcpy(m_data + offset + RECORD_HEADER, record.data(), record.size());
+    __atomic_store_n(record_word(m_data, offset),
+                     RECORD_COMMITTED | static_cast<uint32_t>(record.size()),
+                     __ATOMIC_RELEASE);
+
+    // Будим читателя только если он ждет (порядок с его проверкой - через полный барьер)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_header->reader_waiting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&m_header->wake_seq, 1, __ATOMIC_RELEASE);
+        futex(&m_header->wake_seq, FUTEX_WAKE, 1, nullptr);
+    }
+    return true;
+}
+
+bool ShmRing::peek(string_view& data, size_t& size, bool& pad) const {
+    const uint64_t pos = m_header->read_pos; // Меняет только читатель
+    const size_t offset = pos & (m_capacity - 1);
+    uint32_t word = __atomic_load_n(record_word(m_data, offset), __ATOMIC_ACQUIRE);
+    if (!(word & RECORD_COMMITTED)) {
+        return false;
+    }
+
+    pad = (word & RECORD_PAD) != 0;
+    const size_t length = word & RECORD_LENGTH_MASK;
+    size = pad ? length : align_up(RECORD_HEADER + length);
+    data = string_view(m_data + offset + RECORD_HEADER, pad ? 0 : length);
+    return true;
+}
+
+void ShmRing::release(size_t size) {
+    const uint64_t pos = m_header->read_pos;
+    const size_t offset = pos & (m_capacity - 1);
+    // Следующие записи могут начаться в любом месте освобожденной области,
+    // поэтому она обнуляется целиком до сдвига позиции
+    memset(m_data + offset, 0, size);
+    __atomic_store_n(&m_header->read_pos, pos + size, __ATOMIC_RELEASE);
+}
+
+void ShmRing::wake_writers() {
+    // Порядок со сдвигом read_pos и проверкой писателя - через полный барьер
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_header->writers_waiting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&m_header->space_seq, 1, __ATOMIC_RELEASE);
+        futex(&m_header->space_seq, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
+
+bool ShmRing::wait(int timeout_ms) {
+    string_view data;
+    size_t size;
+    bool pad;
+    if (peek(data, size, pad)) {
+        return true;
+    }
+
+    const uint32_t seq = __atomic_load_n(&m_header->wake_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&m_header->reader_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // Повторная проверка после объявления об ожидании: писатель либо
+    // увидит флаг, либо его запись видна здесь
+    bool ready = peek(data, size, pad);
+    if (!ready) {
+        timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        futex(&m_header->wake_seq, FUTEX_WAIT, seq, &timeout);
+        ready = peek(data, size, pad);
+    }
+    __atomic_store_n(&m_header->reader_waiting, 0, __ATOMIC_RELAXED);
+    return ready;
+}
+
+void ShmRing::unlink() {
+    if (!m_name.empty()) {
+        shm_unlink(m_name.c_str());
+    }
+}
+
+// ShmRingOutput
+ShmRingOutput::ShmRingOutput(const string& name)
+    : name(name), ring(ShmRing::open(name)) {}
+
+void ShmRingOutput::write(const string& message) {
+    if (message.empty()) return;
+    if (!connected) {
+        // Повторное подключение не чаще раза в RECONNECT_INTERVAL:
+        // коллектор мог перезапуститься и создать сегмент заново
+        auto now = chrono::steady_clock::now();
+        if (now >= retry_at) {
+            retry_at = now + RECONNECT_INTERVAL;
+            try {
+                ShmRing reopened = ShmRing::open(name);
+                if (reopened.reader_alive()) {
+                    ring = move(reopened);
+                    connected = true;
+                }
+            } catch (const runtime_error&) {
+                // Сегмента нет - коллектор еще не запущен
+            }
+        }
+        if (!connected) {
+            dropped_count++;
+            return;
+        }
+    }
+    if (!ring.push(message)) {
+        connected = false;
+        retry_at = chrono::steady_clock::now() + RECONNECT_INTERVAL;
+        dropped_count++;
+        throw runtime_error("Shared memory ring reader is gone: " + name);
+    }
+}
+
+bool ShmRingOutput::is_connected() const {
+    return connected && ring.reader_alive();
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// Размер кольца в общей памяти по умолчанию
+constexpr size_t SHM_RING_DEFAULT_CAPACITY = 4 << 20;
+
+// Кольцевой буфер записей в разделяемой памяти (POSIX shm) для передачи
+// журнала между процессами на одном хосте: много писателей, один читатель.
+//
+// Писатель резервирует место сдвигом общей позиции (CAS), копирует запись
+// прямо в сегмент и публикует ее, записав длину в заголовок записи.
+// Читатель разбирает записи на месте и обнуляет прочитанную область.
+// Читатель засыпает на futex только когда кольцо пусто, и писатели
+// делают системный вызов пробуждения лишь в этом случае. Так же писатели
+// ждут места в заполненном кольце.
+//
+// Читатель отмечает сегмент закрытым при выходе, а при пересоздании
+// закрывается и старый сегмент. Писатели проверяют отметку и то, что
+// процесс читателя жив, и не пишут в кольцо, которое никто не читает
+class ShmRing {
+public:
+    struct Header;
+
+    // Создание сегмента (сторона читателя). Существующий сегмент пересоздается
+    static ShmRing create(const std::string& name, size_t capacity = SHM_RING_DEFAULT_CAPACITY);
+    // Подключение к существующему сегменту (сторона писателя)
+    static ShmRing open(const std::string& name);
+
+    ShmRing(ShmRing&& other) noexcept;
+    ShmRing& operator=(ShmRing&& other) noexcept;
+    ~ShmRing();
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // Добавление записи. false - читателя нет (сегмент закрыт или процесс
+    // читателя завершился), запись не добавлена. Если кольцо заполнено
+    // дольше timeout_ms, бросает runtime_error
+    bool push(std::string_view record, int timeout_ms = 1000);
+
+    // Читатель подключен к этому сегменту
+    bool reader_alive() const;
+
+    // Обработка всех опубликованных записей (только читатель).
+    // callback получает string_view на данные в сегменте; после возврата
+    // из callback память записи переиспользуется. Возвращает число записей
+    template <typename Callback>
+    size_t consume(Callback&& callback);
+
+    // Ожидание новых записей (только читатель). false - таймаут
+    bool wait(int timeout_ms);
+
+    // Удаление имени сегмента (подключенные процессы продолжают работу)
+    void unlink();
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    ShmRing() = default;
+    // Следующая запись: данные и полный размер в кольце.
+    // false - записей нет. pad - запись-заполнитель до конца кольца
+    bool peek(std::string_view& data, size_t& size, bool& pad) const;
+    void release(size_t size);
+    // Пробуждение писателей, ждущих места (одно на пакет записей)
+    void wake_writers();
+
+    std::string m_name;
+    Header* m_header = nullptr;
+    char* m_data = nullptr;
+    size_t m_capacity = 0;
+    size_t m_mapping_size = 0;
+    bool m_reader = false; // Сегмент создан этим объектом
+};
+
+template <typename Callback>
+size_t ShmRing::consume(Callback&& callback) {
+    size_t count = 0;
+    std::string_view data;
+    size_t size;
+    bool pad;
+    bool released = false;
+    while (peek(data, size, pad)) {
+        if (!pad) {
+            callback(data);
+            count++;
+        }
+        release(size);
+        released = true;
+    }
+    if (released) {
+        wake_writers();
+    }
+    return count;
+}
+
+// Вывод журнала в кольцо разделяемой памяти. Когда читателя нет, запись
+// сообщает об отключении один раз, затем записи отбрасываются, а
+// подключение к сегменту с тем же именем повторяется раз в секунду
+class ShmRingOutput : public LogOutput {
+public:
+    explicit ShmRingOutput(const std::string& name);
+    void write(const std::string& message) override;
+    bool is_connected() const override;
+
+    // Отброшено записей, пока читателя не было
+    size_t dropped() const { return dropped_count; }
+
+private:
+    std::string name;
+    ShmRing ring;
+    bool connected = true;
+    std::chrono::steady_clock::time_point retry_at;
+    size_t dropped_count = 0;
+};
@@ -0,0 +1,160 @@
+#include "spill_file.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+void write_all(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            throw runtime_error("Spill write failed: " + string(strerror(errno)));
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+} // namespace
+
+SpillFile::~SpillFile() {
+    if (m_fd != -1) {
+        close(m_fd);
+        // Деструктор не бросает исключений: файл, который не удалось
+        // удалить, остается на диске
+        error_code error;
+        filesystem::remove(m_path, error);
+    }
+}
+
+void SpillFile::open(const string& path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        throw runtime_error("Cannot open spill file " + path + ": " + strerror(errno));
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+    m_fd = fd;
+    m_path = path;
+    m_file_size = m_read_pos = 0;
+    m_read_begin = m_read_end = 0;
+    m_write_buffer.clear();
+    m_write_buffer.reserve(SPILL_BUFFER_SIZE);
+    m_read_buffer.resize(SPILL_BUFFER_SIZE);
+}
+
+uint64_t SpillFile::unread() const {
+    return (m_file_size - m_read_pos) + (m_read_end - m_read_begin) + m_write_buffer.size();
+}
+
+void SpillFile::append(const string& message, string_view fields, importances importance,
+                       time_t timestamp, uint32_t producer, uint8_t flags) {
+    Header header{static_cast<uint32_t>(message.size()), static_cast<uint8_t>(importance),
+                  flags, 0, static_cast<int64_t>(timestamp), producer,
+                  static_cast<uint32_t>(fields.size())};
+    const char* raw = reinterpret_cast<const char*>(&header);
+    const size_t previous = m_write_buffer.size();
+    m_write_buffer.insert(m_write_buffer.end(), raw, raw + sizeof(header));
+    m_write_buffer.insert(m_write_buffer.end(), message.begin(), message.end());
+    m_write_buffer.insert(m_write_buffer.end(), fields.begin(), fields.end());
+    if (m_write_buffer.size() >= SPILL_BUFFER_SIZE) {
+        try {
+            flush_writes();
+        } catch (...) {
+            // Запись не принята; предыдущие остаются в буфере до следующей попытки
+            m_write_buffer.resize(previous);
+            throw;
+        }
+    }
+}
+
+void SpillFile::flush_writes() {
+    if (m_write_buffer.empty()) return;
+    write_all(m_fd, m_write_buffer.data(), m_write_buffer.size(), m_file_size);
+    m_file_size += m_write_buffer.size();
+    m_write_buffer.clear(); // Емкость сохраняется
+}
+
+void SpillFile::load(size_t bytes) {
+    // Записи попадают в файл целиком, поэтому непрочитанный хвост
+    // всегда дочитывается
+    while (m_read_end - m_read_begin < bytes) {
+        if (m_read_pos == m_file_size) {
+            flush_writes();
+        }
+        // Остаток переносится в начало, буфер растет под длинную запись
+        size_t available = m_read_end - m_read_begin;
+        memmove(m_read_buffer.data(), m_read_buffer.data() + m_read_begin, available);
+        m_read_begin = 0;
+        m_read_end = available;
+        if (m_read_buffer.size() < bytes) {
+            m_read_buffer.resize(bytes);
+        }
+        // За m_file_size могут лежать остатки неудачной записи
+        ssize_t count = pread(m_fd, m_read_buffer.data() + m_read_end,
+                              min<uint64_t>(m_read_buffer.size() - m_read_end,
+                                            m_file_size - m_read_pos),
+                              m_read_pos);
+        if (count == -1) {
+            if (errno == EINTR) continue;
+            throw runtime_error("Spill read failed: " + string(strerror(errno)));
+        }
+        if (count == 0) {
+            throw runtime_error("Spill file is truncated: " + m_path);
+        }
+        m_read_pos += count;
+        m_read_end += count;
+    }
+}
+
+SpillFile::Header SpillFile::next_header() {
+    load(sizeof(Header));
+    Header header;
+    memcpy(&header, m_read_buffer.data() + m_read_begin, sizeof(header));
+    return header;
+}
+
+size_t SpillFile::next_length() {
+    return next_header().length;
+}
+
+bool SpillFile::read(string& message, string& fields, importances& importance,
+                     time_t& timestamp, uint32_t& producer, uint8_t& flags) {
+    if (empty()) {
+        return false;
+    }
+    Header header = next_header();
+    const size_t size = sizeof(header) + header.length + header.fields_length;
+    load(size);
+    const char* data = m_read_buffer.data() + m_read_begin + sizeof(header);
+    message.assign(data, header.length);
+    fields.assign(data + header.length, header.fields_length);
+    importance = static_cast<importances>(header.importance);
+    timestamp = static_cast<time_t>(header.timestamp);
+    producer = header.producer;
+    flags = header.flags;
+    m_read_begin += size;
+    if (empty()) {
+        reset();
+    }
+    return true;
+}
+
+void SpillFile::reset() {
+    if (m_file_size == 0) return;
+    if (ftruncate(m_fd, 0) == -1) {
+        throw runtime_error("Cannot truncate spill file: " + string(strerror(errno)));
+    }
+    m_file_size = m_read_pos = 0;
+    m_read_begin = m_read_end = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "journal_lib.hpp"
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+
+// Размер буферов записи и чтения файла вытеснения
+constexpr size_t SPILL_BUFFER_SIZE = 64 * 1024;
+
+// Последовательный файл вытеснения очереди: записи дописываются в конец
+// и читаются с начала в том же порядке. Когда все прочитано, файл
+// усекается до нуля. Не потокобезопасен (вызывающий держит блокировку)
+class SpillFile {
+public:
+    SpillFile() = default;
+    ~SpillFile();
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    // Создает (или очищает) файл; удаляется в деструкторе
+    void open(const std::string& path);
+    bool is_open() const { return m_fd != -1; }
+
+    // Исключение - ошибка записи на диск, запись не добавлена
+    void append(const std::string& message, std::string_view fields, importances importance,
+                time_t timestamp, uint32_t producer, uint8_t flags);
+    // Следующая запись по порядку. false - непрочитанных записей нет
+    bool read(std::string& message, std::string& fields, importances& importance,
+              time_t& timestamp, uint32_t& producer, uint8_t& flags);
+    // Длина текста следующей записи без чтения (файл не пуст)
+    size_t next_length();
+
+    bool empty() const { return unread() == 0; }
+    // Байт записано, но еще не прочитано (на диске и в буферах)
+    uint64_t unread() const;
+
+private:
+    // Заголовок записи в файле, за ним length байт текста и
+    // fields_length байт закодированных полей
+    struct Header {
+        uint32_t length;
+        uint8_t importance;
+        uint8_t flags;
+        uint16_t reserved;
+        int64_t timestamp;
+        uint32_t producer;
+        uint32_t fields_length;
+    };
+
+    void flush_writes();
+    // Дочитывание в буфер, пока в нем меньше bytes непрочитанных байт
+    void load(size_t bytes);
+    Header next_header();
+    // Все прочитано: файл усекается, позиции сбрасываются
+    void reset();
+
+    int m_fd = -1;
+    std::string m_path;
+    uint64_t m_file_size = 0; // Записано в файл
+    uint64_t m_read_pos = 0;  // Смещение первого не загруженного в буфер байта
+    std::vector<char> m_write_buffer;
+    std::vector<char> m_read_buffer;
+    size_t m_read_begin = 0;  // Непрочитанные байты [m_read_begin, m_read_end)
+    size_t m_read_end = 0;
+};
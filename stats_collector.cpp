@@ -1,100 +1,170 @@
-#include "journal_lib.hpp"
+#include "stats_query.hpp"
+#include "rollup_store.hpp"
+#include "shm_ring.hpp"
+#include "log_tail.hpp"
+#include "record_scan.hpp"
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <ctime>
-#include <unordered_map>
-#include <algorithm>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
 #include <cerrno>
-#include <mutex>
+#include <poll.h>
+#include <csignal>
+#include <memory>
+#include <algorithm>
+#include <cctype>
 
 using namespace std;
 
-// Структура для хранения статистики
-struct MessageStats {
-    mutex stats_mutex; // Для защиты многопоточного доступа
-    size_t total = 0;
-    size_t min_len = 0;
-    size_t max_len = 0;
-    double avg_len = 0.0;
-    unordered_map<importances, size_t> by_importance = {
-        {importances::LOW, 0},
-        {importances::MEDIUM, 0},
-        {importances::HIGH, 0}
-    };
-    vector<pair<time_t, size_t>> last_hour; // Сообщения за последний час
-};
+// Минимальный интервал между публикациями снимка для запросов (мс)
+constexpr int64_t SNAPSHOT_INTERVAL_MS = 100;
+
+// Флаг остановки по SIGINT/SIGTERM (агрегаты дописываются перед выходом)
+volatile sig_atomic_t stop_requested = 0;
 
-// Определение уровня важности из сообщения
-importances parse_importance(const string& msg) {
-    if (msg.find("[LOW]") != string::npos) return importances::LOW;
-    if (msg.find("[MEDIUM]") != string::npos) return importances::MEDIUM;
-    return importances::HIGH;
+void handle_stop_signal(int) {
+    stop_requested = 1;
 }
 
-// Обновление статистики (потокобезопасное)
-void update_stats(MessageStats& stats, const string& msg, time_t now) {
-    lock_guard<mutex> lock(stats.stats_mutex); 
-    
-    stats.total++;
-    const size_t len = msg.size();
-    
-    // Статистика длин
-    if (stats.total == 1) {
-        stats.min_len = stats.max_len = len;
-    } else {
-        stats.min_len = min(stats.min_len, len);
-        stats.max_len = max(stats.max_len, len);
-    }
-    stats.avg_len = (stats.avg_len * (stats.total - 1) + len) / stats.total;
-    
-    // Статистика по важности
-    importances imp = parse_importance(msg);
-    stats.by_importance[imp]++;
-    
-    // За последний час
-    stats.last_hour.emplace_back(now, len);
-    stats.last_hour.erase(
-        remove_if(stats.last_hour.begin(), stats.last_hour.end(),
-            [now](const auto& entry) { return now - entry.first > 3600; }),
-        stats.last_hour.end()
-    );
+void print_usage(const char* program) {
+    cout << "Usage: " << program << " <port> <N> <T> [--query-port <port>] [--rollup <file>]\n"
+         << "       " << program << " --shm <name> <N> <T> [--query-port <port>] [--rollup <file>]\n"
+         << "       " << program << " --follow <file>[,<file>...] <N> <T> [--query-port <port>] [--rollup <file>]\n"
+         << "       " << program << " --rollup-query <file> <from> <to> [step_minutes]\n"
+         << "Options: --echo-every <n> prints every n-th record (0 - none, default 1)\n"
+         << "Time is epoch seconds, 'YYYY-MM-DD HH:MM' or 'now'\n";
 }
 
-// Вывод статистики
-void print_stats(MessageStats& stats) {  
-    lock_guard<mutex> lock(stats.stats_mutex); 
-    
-    cout << "\n=== Statistics ===\n";
-    cout << "Total messages: " << stats.total << "\n";
-    cout << "By importance:\n"
-         << "  LOW:    " << stats.by_importance.at(importances::LOW) << "\n"
-         << "  MEDIUM: " << stats.by_importance.at(importances::MEDIUM) << "\n"
-         << "  HIGH:   " << stats.by_importance.at(importances::HIGH) << "\n";
-    cout << "Last hour: " << stats.last_hour.size() << " messages\n";
-    cout << "Message lengths:\n"
-         << "  Min: " << stats.min_len << "\n"
-         << "  Max: " << stats.max_len << "\n"
-         << "  Avg: " << stats.avg_len << "\n";
-    cout << "=================\n";
+// Разбор времени для запроса агрегатов
+time_t parse_time_arg(const string& value) {
+    if (value == "now") {
+        return time(nullptr);
+    }
+    if (!value.empty() && all_of(value.begin(), value.end(), ::isdigit)) {
+        return static_cast<time_t>(stoll(value));
+    }
+    for (const char* format : {"%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d"}) {
+        tm time_info{};
+        const char* end = strptime(value.c_str(), format, &time_info);
+        if (end != nullptr && *end == '\0') {
+            time_info.tm_isdst = -1;
+            return mktime(&time_info);
+        }
+    }
+    throw invalid_argument("Invalid time: " + value);
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        cout << "Usage: " << argv[0] << " <port> <N> <T>\n";
+// Режим запроса: вывод поминутных агрегатов за интервал
+int run_rollup_query(int argc, char* argv[]) {
+    if (argc < 5) {
+        print_usage(argv[0]);
         return 1;
     }
+    try {
+        const int64_t from = parse_time_arg(argv[3]) / 60;
+        const int64_t to = parse_time_arg(argv[4]) / 60;
+        const int64_t step = argc > 5 ? stoll(argv[5]) : 1;
+        print_rollups(query_rollups(argv[2], from, to), step);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Состояние коллектора, общее для приема по сокету и из общей памяти
+class Collector {
+public:
+    // echo_every - выводить каждую echo_every-ю запись (0 - не выводить)
+    Collector(size_t N, size_t T, size_t echo_every) : N(N), T(T), echo_every(echo_every) {}
+
+    // Дополнительные выходы (вызываются до начала приема)
+    void open_rollup(const string& filename) {
+        rollup = make_unique<RollupWriter>(filename);
+    }
+    void start_query_server(int port) {
+        query_server = make_unique<SnapshotServer>(port, published_snapshot);
+        cout << "Snapshot queries on port " << port << endl;
+    }
 
-    const int port = stoi(argv[1]);
-    const size_t N = stoul(argv[2]); // Выводить каждые N сообщений
-    const size_t T = stoul(argv[3]); // Выводить через T секунд после последнего изменения
+    // Обработка одной принятой записи
+    void handle_record(string_view message, time_t now, string_view source) {
+        importances importance = update_stats(stats, message, now, source);
+        if (rollup) {
+            rollup->add(now, importance, message.size());
+        }
+        // Эхо выборочное и без сброса буфера после каждой записи
+        if (echo_every > 0 && stats.total % echo_every == 0) {
+            cout << "Received: " << message << '\n';
+        }
+
+        // Проверка вывода по количеству сообщений
+        if (stats.total % N == 0) {
+            print_stats(stats);
+            last_printed_total = stats.total;
+        }
+
+        // Запускаем/сбрасываем таймер
+        last_activity_time = now;
+        waiting_for_message = false; // Таймер активен
+    }
+
+    // Периодические действия: публикация снимка и вывод по таймауту
+    void on_tick(time_t now) {
+        // Публикация снимка не чаще SNAPSHOT_INTERVAL_MS и только при изменениях
+        auto steady_now = chrono::steady_clock::now();
+        if (query_server && stats.total != last_published_total &&
+            steady_now - last_publish >= chrono::milliseconds(SNAPSHOT_INTERVAL_MS)) {
+            published_snapshot.store(make_snapshot(stats, now));
+            last_published_total = stats.total;
+            last_publish = steady_now;
+        }
 
+        // Проверяем таймаут только если ожидаем сообщения (таймер запущен)
+        if (!waiting_for_message && difftime(now, last_activity_time) >= T) {
+            if (stats.total > last_printed_total) {
+                print_stats(stats);
+                last_printed_total = stats.total;
+            }
+            waiting_for_message = true; // Сбрасываем таймер, ждем новое сообщение
+        }
+    }
+
+    // Завершение работы: дописывание агрегатов
+    void finish() {
+        if (rollup) {
+            rollup->flush();
+        }
+    }
+
+private:
+    const size_t N; // Выводить каждые N сообщений
+    const size_t T; // Выводить через T секунд после последнего изменения
+    const size_t echo_every;
+
+    MessageStats stats;
+    unique_ptr<RollupWriter> rollup;
+
+    // Снимок для запросов публикуется без блокировки читателей
+    Seqlock<StatsSnapshot> published_snapshot;
+    unique_ptr<SnapshotServer> query_server;
+    chrono::steady_clock::time_point last_publish = chrono::steady_clock::now();
+    size_t last_published_total = 0;
+
+    time_t last_activity_time = time(nullptr); // Время последнего сообщения
+    size_t last_printed_total = 0;             // Количество сообщений при последнем выводе
+    bool waiting_for_message = true;           // Флаг ожидания нового сообщения для старта таймера
+};
+
+// Прием по TCP. Работа завершается, когда отключится последний клиент
+int run_socket(Collector& collector, int port) {
     // Создание сокета
     int listen_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (listen_socket == -1) {
@@ -131,77 +201,223 @@ int main(int argc, char* argv[]) {
 
     cout << "Listening on port " << port << "..." << endl;
 
-    // Принятие подключения
-    sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_socket = accept(listen_socket, (sockaddr*)&client_addr, &client_len);
-    if (client_socket == -1) {
-        cerr << "Accept failed: " << strerror(errno) << endl;
-        close(listen_socket);
-        return 1;
-    }
-
-    cout << "Client connected from " << inet_ntoa(client_addr.sin_addr) 
-         << ":" << ntohs(client_addr.sin_port) << endl;
-
-    MessageStats stats;
-    time_t last_activity_time = time(nullptr); // Время последнего сообщения
-    size_t last_printed_total = 0;             // Количество сообщений при последнем выводе
+    // Подключенные клиенты; pending - начало записи, не завершенной переводом строки
+    struct Client {
+        int socket;
+        string source;
+        string pending;
+    };
+    vector<Client> clients;
+    bool had_clients = false;
 
-    // Основной цикл обработки сообщений
-    char buffer[4096];
-    bool waiting_for_message = true; // Флаг ожидания нового сообщения для старта таймера
+    // Общий буфер приема: данные читаются прямо в него, записи передаются
+    // в статистику как string_view без копирования
+    RecordBuffer receive;
+    vector<pollfd> poll_fds;
     
-    while (true) {
+    while ((!had_clients || !clients.empty()) && !stop_requested) {
+        collector.on_tick(time(nullptr));
+    
+        // Ожидание новых подключений и данных с таймаутом 1 секунда
+        poll_fds.clear();
+        poll_fds.push_back({listen_socket, POLLIN, 0});
+        for (const Client& client : clients) {
+            poll_fds.push_back({client.socket, POLLIN, 0});
+        }
+        int ready = poll(poll_fds.data(), poll_fds.size(), 1000);
+        if (ready == -1) {
+            if (errno == EINTR) continue; // Проверка stop_requested в условии цикла
+            cerr << "Poll error: " << strerror(errno) << endl;
+            break;
+        }
+        if (ready == 0) continue;
         time_t now = time(nullptr);
-        
-        // Проверяем таймаут только если ожидаем сообщения (таймер запущен)
-        if (!waiting_for_message && difftime(now, last_activity_time) >= T) {
-            if (stats.total > last_printed_total) {
-                print_stats(stats);
-                last_printed_total = stats.total;
+
+        // Данные от клиентов (обход с конца, чтобы удалять отключившихся)
+        for (size_t i = clients.size(); i-- > 0;) {
+            if (!(poll_fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Client& client = clients[i];
+            auto handle = [&](string_view record) {
+                collector.handle_record(record, now, client.source);
+            };
+
+            // Записи разделяются переводом строки и могут приходить частями
+            receive.load_pending(client.pending);
+            ssize_t bytes_received = recv(client.socket, receive.space(), receive.space_size(), 0);
+            if (bytes_received > 0) {
+                receive.commit(bytes_received, handle);
+                receive.save_pending(client.pending);
+                continue;
             }
-            waiting_for_message = true; // Сбрасываем таймер, ждем новое сообщение
-        }
-    
-        // Чтение сообщения с таймаутом
-        struct timeval tv;
-        tv.tv_sec = 1; // Таймаут 1 секунда
-        tv.tv_usec = 0;
-        setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_received > 0) {
-            // Обработка нового сообщения
-            buffer[bytes_received] = '\0';
-            string message(buffer);
-            
-            update_stats(stats, message, now);
-            cout << "Received: " << message << endl;
-            
-            // Запускаем/сбрасываем таймер
-            last_activity_time = now;
-            waiting_for_message = false; // Таймер активен
-            
-            // Проверка вывода по количеству сообщений
-            if (stats.total % N == 0) {
-                print_stats(stats);
-                last_printed_total = stats.total;
+            if (bytes_received == -1 && (errno == EAGAIN || errno == EINTR)) {
+                receive.save_pending(client.pending);
+                continue;
             }
-        }
-        else if (bytes_received == 0) {
+            if (bytes_received == -1) {
+                cerr << "Receive error: " << strerror(errno) << endl;
+            }
+
+            // Незавершенная запись учитывается при отключении
+            receive.finish(handle);
             cout << "Client disconnected" << endl;
-            break;
+            close(client.socket);
+            clients.erase(clients.begin() + i);
         }
-        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            cerr << "Receive error: " << strerror(errno) << endl;
-            break;
+
+        // Принятие подключения
+        if (poll_fds[0].revents & POLLIN) {
+            sockaddr_in client_addr;
+            socklen_t client_len = sizeof(client_addr);
+            int client_socket = accept(listen_socket, (sockaddr*)&client_addr, &client_len);
+            if (client_socket == -1) {
+                cerr << "Accept failed: " << strerror(errno) << endl;
+                continue;
+            }
+
+            // Клиент - соединение (адрес и порт): так различаются процессы на одном хосте
+            string source = string(inet_ntoa(client_addr.sin_addr)) + ":" + 
+                            to_string(ntohs(client_addr.sin_port));
+            cout << "Client connected from " << source << endl;
+            clients.push_back({client_socket, move(source), string()});
+            had_clients = true;
         }
     }
 
-    // Завершение работы
-    close(client_socket);
+    for (const Client& client : clients) {
+        close(client.socket);
+    }
     close(listen_socket);
     return 0;
-}
\ No newline at end of file
+}
+
+// Прием из кольца в общей памяти. Записи разбираются прямо в сегменте;
+// писатели будят коллектор только когда он ждет. Работа продолжается
+// до SIGINT/SIGTERM, сегмент удаляется при выходе
+int run_shm(Collector& collector, const string& name) {
+    try {
+        ShmRing ring = ShmRing::create(name);
+        cout << "Reading shared memory ring " << name << "..." << endl;
+
+        const string source = "shm:" + name;
+        while (!stop_requested) {
+            time_t now = time(nullptr);
+            collector.on_tick(now);
+            if (!ring.wait(1000)) continue;
+            now = time(nullptr);
+            ring.consume([&](string_view record) {
+                collector.handle_record(record, now, source);
+            });
+        }
+        ring.unlink();
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Слежение за файлами журналов (как tail -F). Источник записи - путь файла.
+// Работа продолжается до SIGINT/SIGTERM
+int run_follow(Collector& collector, const vector<string>& paths) {
+    try {
+        LogTailer tailer(paths);
+        cout << "Following " << paths.size() << " file(s)..." << endl;
+
+        while (!stop_requested) {
+            time_t now = time(nullptr);
+            collector.on_tick(now);
+            if (!tailer.wait(1000)) continue;
+            now = time(nullptr);
+            tailer.process([&](string_view record, string_view source) {
+                collector.handle_record(record, now, source);
+            });
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--rollup-query") {
+        return run_rollup_query(argc, argv);
+    }
+
+    // Источник: порт TCP, имя сегмента общей памяти или файлы журналов
+    string shm_name;
+    vector<string> follow_paths;
+    int first = 1;
+    if (argc > 2 && string(argv[1]) == "--shm") {
+        shm_name = argv[2];
+        first = 2;
+    } else if (argc > 2 && string(argv[1]) == "--follow") {
+        string list = argv[2];
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t comma = list.find(',', start);
+            if (comma == string::npos) comma = list.size();
+            if (comma > start) follow_paths.push_back(list.substr(start, comma - start));
+            start = comma + 1;
+        }
+        first = 2;
+    }
+    if (argc < first + 3 || (first == 2 && shm_name.empty() && follow_paths.empty())) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const int port = first == 1 ? stoi(argv[1]) : 0;
+    const size_t N = stoul(argv[first + 1]); // Выводить каждые N сообщений
+    const size_t T = stoul(argv[first + 2]); // Выводить через T секунд после последнего изменения
+
+    // Дополнительные параметры
+    int query_port = 0; // Порт запросов снимка статистики (0 - отключен)
+    string rollup_file; // Файл поминутных агрегатов (пусто - не сохранять)
+    size_t echo_every = 1; // Эхо каждой echo_every-й записи (0 - отключено)
+    for (int i = first + 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--query-port" && i + 1 < argc) {
+            query_port = stoi(argv[++i]);
+        } else if (arg == "--rollup" && i + 1 < argc) {
+            rollup_file = argv[++i];
+        } else if (arg == "--echo-every" && i + 1 < argc) {
+            echo_every = stoul(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Collector collector(N, T, echo_every);
+    try {
+        if (!rollup_file.empty()) {
+            collector.open_rollup(rollup_file);
+        }
+        if (query_port > 0) {
+            collector.start_query_server(query_port);
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    // Остановка по сигналу без SA_RESTART прерывает poll и ожидание futex
+    struct sigaction stop_action{};
+    stop_action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &stop_action, nullptr);
+    sigaction(SIGTERM, &stop_action, nullptr);
+
+    int result;
+    if (!shm_name.empty()) {
+        result = run_shm(collector, shm_name);
+    } else if (!follow_paths.empty()) {
+        result = run_follow(collector, follow_paths);
+    } else {
+        result = run_socket(collector, port);
+    }
+
+    // Завершение работы
+    collector.finish();
+    return result;
+}
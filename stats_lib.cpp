@@ -0,0 +1,281 @@
+#include "stats_lib.hpp"
+#include "record_scan.hpp"
+#include "journal_probes.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+importances parse_importance(string_view msg) {
+    return scan_importance(msg);
+}
+
+namespace {
+
+// Учет одного структурированного поля (вызывается под stats_mutex)
+void update_field_stats(MessageStats& stats, const ParsedLogField& field) {
+    string key(field.key);
+    double value = 0.0;
+    if (field.type == LogField::Type::STRING) {
+        key += '=';
+        key += field.value;
+    } else {
+        auto res = from_chars(field.value.data(), field.value.data() + field.value.size(), value);
+        if (res.ec != errc()) {
+            stats.dropped_fields++;
+            return;
+        }
+    }
+
+    auto it = stats.fields.find(key);
+    if (it == stats.fields.end()) {
+        if (stats.fields.size() >= MAX_FIELD_KEYS) {
+            stats.dropped_fields++;
+            return;
+        }
+        it = stats.fields.emplace(move(key), FieldStats{}).first;
+    }
+    it->second.count++;
+    it->second.sum += value;
+}
+
+} // namespace
+
+// ClientStats
+double ClientStats::rate(time_t now) const {
+    const time_t elapsed = now - interval_start;
+    if (elapsed >= 2 * CLIENT_RATE_INTERVAL) return 0.0; // Давно не писал
+    const size_t count = elapsed >= CLIENT_RATE_INTERVAL ? interval_count : previous_count;
+    return static_cast<double>(count) / CLIENT_RATE_INTERVAL;
+}
+
+// ClientTable
+ClientTable::ClientTable(size_t capacity, time_t idle_timeout)
+    : m_capacity(max<size_t>(capacity, 1)), m_idle_timeout(idle_timeout) {}
+
+void ClientTable::expire(time_t now) {
+    // Записи в конце списка - самые давние
+    while (!m_lru.empty() && now - m_lru.back().last_seen > m_idle_timeout) {
+        m_evicted++;
+        m_evicted_messages += m_lru.back().total;
+        m_index.erase(hash_string(m_lru.back().source));
+        m_lru.pop_back();
+    }
+}
+
+void ClientTable::update(string_view source, importances importance, size_t bytes, time_t now) {
+    source = source.substr(0, MAX_SOURCE_LEN);
+    m_now = max(m_now, now);
+    expire(m_now);
+
+    const uint64_t hash = hash_string(source);
+    auto found = m_index.find(hash);
+    if (found != m_index.end() && found->second->source != source) {
+        // Совпадение хешей разных имен: прежний клиент считается вытесненным
+        m_evicted++;
+        m_evicted_messages += found->second->total;
+        m_lru.erase(found->second);
+        m_index.erase(found);
+        found = m_index.end();
+    }
+
+    if (found == m_index.end()) {
+        if (m_index.size() >= m_capacity) {
+            // Узел самого давнего клиента переиспользуется для нового
+            ClientStats& oldest = m_lru.back();
+            m_evicted++;
+            m_evicted_messages += oldest.total;
+            m_index.erase(hash_string(oldest.source));
+            m_lru.splice(m_lru.begin(), m_lru, prev(m_lru.end()));
+            string name = move(m_lru.front().source);
+            name.assign(source.data(), source.size());
+            m_lru.front() = ClientStats();
+            m_lru.front().source = move(name);
+        } else {
+            m_lru.emplace_front();
+            m_lru.front().source.assign(source.data(), source.size());
+        }
+        m_lru.front().first_seen = now;
+        m_lru.front().interval_start = now - now % CLIENT_RATE_INTERVAL;
+        found = m_index.emplace(hash, m_lru.begin()).first;
+    } else if (found->second != m_lru.begin()) {
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+    }
+
+    ClientStats& client = m_lru.front();
+    client.total++;
+    client.by_importance[static_cast<int>(importance)]++;
+    client.bytes += bytes;
+    client.last_seen = max(client.last_seen, now);
+
+    // Интервалы скорости выровнены по CLIENT_RATE_INTERVAL
+    const time_t interval = now - now % CLIENT_RATE_INTERVAL;
+    if (interval > client.interval_start) {
+        client.previous_count = interval - client.interval_start == CLIENT_RATE_INTERVAL 
+                                ? client.interval_count : 0;
+        client.interval_start = interval;
+        client.interval_count = 0;
+    }
+    client.interval_count++;
+}
+
+vector<const ClientStats*> ClientTable::top(size_t limit) const {
+    vector<const ClientStats*> result;
+    result.reserve(m_lru.size());
+    for (const ClientStats& client : m_lru) {
+        result.push_back(&client);
+    }
+    limit = min(limit, result.size());
+    partial_sort(result.begin(), result.begin() + limit, result.end(),
+                 [](const ClientStats* a, const ClientStats* b) {
+                     return a->total != b->total ? a->total > b->total : a->source < b->source;
+                 });
+    result.resize(limit);
+    return result;
+}
+
+importances update_stats(MessageStats& stats, string_view msg, time_t now, string_view source) {
+    lock_guard<mutex> lock(stats.stats_mutex); 
+    
+    stats.total++;
+    const size_t len = msg.size();
+    
+    // Статистика длин
+    if (stats.total == 1) {
+        stats.min_len = stats.max_len = len;
+    } else {
+        stats.min_len = min(stats.min_len, len);
+        stats.max_len = max(stats.max_len, len);
+    }
+    stats.avg_len = (stats.avg_len * (stats.total - 1) + len) / stats.total;
+    
+    // Структурированные поля отделяются по разделителю, текст не разбирается
+    string_view text = for_each_log_field(msg, [&stats](const ParsedLogField& field) {
+        update_field_stats(stats, field);
+    });
+
+    // Статистика по важности
+    importances imp = parse_importance(text);
+    stats.by_importance[imp]++;
+
+    // Частые шаблоны
+    normalize_template(text, stats.template_buf);
+    stats.top_templates.add(stats.template_buf);
+
+    // Различные шаблоны и источники; окно сбрасывается по истечении DISTINCT_WINDOW
+    if (now - stats.window_start >= DISTINCT_WINDOW) {
+        stats.window_start = now - now % DISTINCT_WINDOW;
+        stats.window_templates.clear();
+        stats.window_sources.clear();
+    }
+    uint64_t template_hash = hash_string(stats.template_buf);
+    stats.distinct_templates.add_hash(template_hash);
+    stats.window_templates.add_hash(template_hash);
+    if (!source.empty()) {
+        uint64_t source_hash = hash_string(source);
+        stats.distinct_sources.add_hash(source_hash);
+        stats.window_sources.add_hash(source_hash);
+        stats.clients.update(source, imp, len, now);
+    }
+    
+    // За последний час
+    // Записи добавляются по возрастанию времени, устаревшие всегда в начале
+    stats.last_hour.emplace_back(now, len);
+    while (!stats.last_hour.empty() && now - stats.last_hour.front().first > 3600) {
+        stats.last_hour.pop_front();
+    }
+    JOURNAL_PROBE(stats__update, len, static_cast<int>(imp), static_cast<int64_t>(now));
+    return imp;
+}
+
+namespace {
+
+// Формирование текста отчета (под блокировкой статистики)
+string format_stats(MessageStats& stats) {
+    lock_guard<mutex> lock(stats.stats_mutex); 
+    ostringstream report;
+    
+    report << "\n=== Statistics ===\n";
+    report << "Total messages: " << stats.total << "\n";
+    report << "By importance:\n"
+        << "  LOW:    " << stats.by_importance.at(importances::LOW) << "\n"
+        << "  MEDIUM: " << stats.by_importance.at(importances::MEDIUM) << "\n"
+        << "  HIGH:   " << stats.by_importance.at(importances::HIGH) << "\n";
+    report << "Last hour: " << stats.last_hour.size() << " messages\n";
+    report << "Message lengths:\n"
+        << "  Min: " << stats.min_len << "\n"
+        << "  Max: " << stats.max_len << "\n"
+        << "  Avg: " << stats.avg_len << "\n";
+
+    report << "Distinct (approx.):\n"
+        << "  Templates: " << llround(stats.distinct_templates.estimate())
+        << " (window: " << llround(stats.window_templates.estimate()) << ")\n"
+        << "  Sources:   " << llround(stats.distinct_sources.estimate())
+        << " (window: " << llround(stats.window_sources.estimate()) << ")\n";
+
+    vector<TopK::Entry> top = stats.top_templates.top(TOP_K_REPORT);
+    if (!top.empty()) {
+        report << "Top messages:\n";
+        for (const auto& entry : top) {
+            report << "  " << entry.count;
+            if (entry.error > 0) {
+                report << " (+-" << entry.error << ")";
+            }
+            report << "  " << entry.key << "\n";
+        }
+    }
+
+    if (!stats.fields.empty()) {
+        // Сортируем ключи, чтобы вывод был стабильным
+        vector<const pair<const string, FieldStats>*> sorted;
+        sorted.reserve(stats.fields.size());
+        for (const auto& entry : stats.fields) {
+            sorted.push_back(&entry);
+        }
+        sort(sorted.begin(), sorted.end(),
+             [](const auto* a, const auto* b) { return a->first < b->first; });
+
+        report << "Fields:\n";
+        for (const auto* entry : sorted) {
+            report << "  " << entry->first << ": count " << entry->second.count;
+            if (entry->first.find('=') == string::npos) {
+                report << ", sum " << entry->second.sum;
+            }
+            report << "\n";
+        }
+        if (stats.dropped_fields > 0) {
+            report << "  (dropped: " << stats.dropped_fields << ")\n";
+        }
+    }
+    if (stats.clients.size() > 0 || stats.clients.evicted() > 0) {
+        // Самые активные клиенты; скорость - за последний полный интервал
+        const time_t now = stats.clients.last_update();
+        report << "Clients (" << stats.clients.size() << " active";
+        if (stats.clients.evicted() > 0) {
+            report << ", " << stats.clients.evicted() << " evicted with "
+                   << stats.clients.evicted_messages() << " messages";
+        }
+        report << "):\n";
+        for (const ClientStats* client : stats.clients.top(CLIENT_REPORT)) {
+            report << "  " << client->source << ": " << client->total
+                   << " (L " << client->by_importance[0]
+                   << " / M " << client->by_importance[1]
+                   << " / H " << client->by_importance[2] << "), "
+                   << client->bytes << " bytes, "
+                   << client->rate(now) << " msg/s\n";
+        }
+    }
+    report << "=================\n";
+    return report.str();
+}
+
+} // namespace
+
+void print_stats(MessageStats& stats, ostream& out) {  
+    // Отчет собирается в память под блокировкой, а выводится уже без нее,
+    // чтобы медленный вывод не задерживал update_stats
+    string report = format_stats(stats);
+    out << report << flush;
+}
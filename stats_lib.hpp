@@ -0,0 +1,138 @@
+#pragma once
+#include "journal_lib.hpp"
+#include "stats_sketches.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <list>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <mutex>
+#include <ctime>
+#include <iostream>
+
+// Максимальное число различных ключей структурированных полей.
+// Значения сверх лимита учитываются в счетчике dropped_fields
+constexpr size_t MAX_FIELD_KEYS = 1024;
+
+// Число отслеживаемых шаблонов сообщений и сколько из них выводить
+constexpr size_t TOP_K_CAPACITY = 64;
+constexpr size_t TOP_K_REPORT = 5;
+
+// Длительность окна для оценок числа различных элементов (секунды)
+constexpr time_t DISTINCT_WINDOW = 3600;
+
+// Таблица клиентов: не больше MAX_CLIENTS записей, клиенты без сообщений
+// дольше CLIENT_IDLE_TIMEOUT секунд удаляются. В отчете - CLIENT_REPORT клиентов
+constexpr size_t MAX_CLIENTS = 256;
+constexpr time_t CLIENT_IDLE_TIMEOUT = 600;
+constexpr size_t CLIENT_REPORT = 10;
+// Интервал подсчета скорости клиента (секунды) и максимальная длина имени
+constexpr time_t CLIENT_RATE_INTERVAL = 10;
+constexpr size_t MAX_SOURCE_LEN = 64;
+
+// Статистика одного клиента (соединения)
+struct ClientStats {
+    std::string source;
+    size_t total = 0;
+    std::array<size_t, 3> by_importance{}; // LOW, MEDIUM, HIGH
+    size_t bytes = 0;
+    time_t first_seen = 0;
+    time_t last_seen = 0;
+
+    // Скорость: сообщения текущего и предыдущего интервала CLIENT_RATE_INTERVAL
+    time_t interval_start = 0;
+    size_t interval_count = 0;
+    size_t previous_count = 0;
+
+    // Сообщений в секунду за последний полный интервал
+    double rate(time_t now) const;
+};
+
+// Ограниченная таблица клиентов с вытеснением давно не писавших (LRU).
+// Память не зависит от числа клиентов за все время: при переполнении
+// вытесняется клиент, дольше всех не присылавший сообщений, а освободившийся
+// узел переиспользуется для нового
+class ClientTable {
+public:
+    explicit ClientTable(size_t capacity = MAX_CLIENTS, time_t idle_timeout = CLIENT_IDLE_TIMEOUT);
+
+    void update(std::string_view source, importances importance, size_t bytes, time_t now);
+
+    // Клиенты по убыванию числа сообщений (не больше limit)
+    std::vector<const ClientStats*> top(size_t limit) const;
+    size_t size() const { return m_index.size(); }
+    // Вытесненные клиенты и их сообщения
+    size_t evicted() const { return m_evicted; }
+    size_t evicted_messages() const { return m_evicted_messages; }
+    // Время последнего обновления (для расчета скорости в отчете)
+    time_t last_update() const { return m_now; }
+
+private:
+    void expire(time_t now);
+
+    size_t m_capacity;
+    time_t m_idle_timeout;
+    // Порядок использования: в начале - последний писавший клиент
+    std::list<ClientStats> m_lru;
+    // Ключ - хеш имени клиента (имя сверяется при поиске)
+    std::unordered_map<uint64_t, std::list<ClientStats>::iterator> m_index;
+    size_t m_evicted = 0;
+    size_t m_evicted_messages = 0;
+    time_t m_now = 0;
+};
+
+// Агрегат по структурированному полю
+struct FieldStats {
+    size_t count = 0; // Сколько раз встретилось
+    double sum = 0.0; // Сумма значений (только для числовых полей)
+};
+
+// Структура для хранения статистики
+struct MessageStats {
+    std::mutex stats_mutex; // Для защиты многопоточного доступа
+    size_t total = 0;
+    size_t min_len = 0;
+    size_t max_len = 0;
+    double avg_len = 0.0;
+    std::unordered_map<importances, size_t> by_importance = {
+        {importances::LOW, 0},
+        {importances::MEDIUM, 0},
+        {importances::HIGH, 0}
+    };
+    std::deque<std::pair<time_t, size_t>> last_hour; // Сообщения за последний час (по времени прихода)
+
+    // Числовые поля агрегируются по ключу ("key"),
+    // строковые - по паре ключ/значение ("key=value")
+    std::unordered_map<std::string, FieldStats> fields;
+    size_t dropped_fields = 0;
+
+    // Самые частые шаблоны сообщений (фиксированный объем памяти)
+    TopK top_templates{TOP_K_CAPACITY};
+    std::string template_buf; // Переиспользуемый буфер нормализации
+
+    // Приблизительное число различных шаблонов и источников:
+    // за все время и за текущее окно DISTINCT_WINDOW
+    HyperLogLog distinct_templates;
+    HyperLogLog distinct_sources;
+    HyperLogLog window_templates;
+    HyperLogLog window_sources;
+    time_t window_start = 0;
+
+    // Статистика по клиентам (source из update_stats)
+    ClientTable clients;
+};
+
+// Определение уровня важности из сообщения
+importances parse_importance(std::string_view msg);
+
+// Обновление статистики (потокобезопасное).
+// source - идентификатор клиента (адрес и порт), пустой если неизвестен.
+// Возвращает уровень важности, определенный по сообщению
+importances update_stats(MessageStats& stats, std::string_view msg, time_t now,
+                  std::string_view source = {});
+
+// Вывод статистики
+void print_stats(MessageStats& stats, std::ostream& out = std::cout);
@@ -0,0 +1,208 @@
+#include "stats_query.hpp"
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Копирование строки в массив снимка с обрезкой по границе символа UTF-8
+template <size_t N>
+void copy_text(char (&dst)[N], string_view src) {
+    size_t length = min(src.size(), N - 1);
+    if (length < src.size()) {
+        while (length > 0 && (static_cast<unsigned char>(src[length]) & 0xC0) == 0x80) {
+            --length;
+        }
+    }
+    memcpy(dst, src.data(), length);
+    dst[length] = '\0';
+}
+
+// Строка JSON в кавычках с экранированием
+void write_json_string(ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; ++c) {
+        const unsigned char byte = static_cast<unsigned char>(*c);
+        if (byte == '"' || byte == '\\') {
+            out << '\\' << *c;
+        } else if (byte < 0x20) {
+            static const char HEX[] = "0123456789abcdef";
+            out << "\\u00" << HEX[byte >> 4] << HEX[byte & 0xF];
+        } else {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+StatsSnapshot make_snapshot(MessageStats& stats, time_t now) {
+    StatsSnapshot snapshot;
+    snapshot.timestamp = now;
+
+    lock_guard<mutex> lock(stats.stats_mutex);
+    snapshot.total = stats.total;
+    snapshot.low = stats.by_importance.at(importances::LOW);
+    snapshot.medium = stats.by_importance.at(importances::MEDIUM);
+    snapshot.high = stats.by_importance.at(importances::HIGH);
+    snapshot.last_hour = stats.last_hour.size();
+    snapshot.min_len = stats.min_len;
+    snapshot.max_len = stats.max_len;
+    snapshot.avg_len = stats.avg_len;
+    snapshot.distinct_templates = stats.distinct_templates.estimate();
+    snapshot.distinct_sources = stats.distinct_sources.estimate();
+    snapshot.window_templates = stats.window_templates.estimate();
+    snapshot.window_sources = stats.window_sources.estimate();
+
+    for (const TopK::Entry& entry : stats.top_templates.top(SNAPSHOT_TEMPLATES)) {
+        SnapshotTemplate& item = snapshot.templates[snapshot.template_count++];
+        copy_text(item.text, entry.key);
+        item.count = entry.count;
+        item.error = entry.error;
+    }
+
+    // Полей может быть до MAX_FIELD_KEYS - в снимок попадают самые частые
+    vector<const pair<const string, FieldStats>*> fields;
+    fields.reserve(stats.fields.size());
+    for (const auto& entry : stats.fields) {
+        fields.push_back(&entry);
+    }
+    const size_t field_count = min(fields.size(), SNAPSHOT_FIELDS);
+    partial_sort(fields.begin(), fields.begin() + field_count, fields.end(),
+                 [](const auto* a, const auto* b) {
+                     return a->second.count != b->second.count
+                         ? a->second.count > b->second.count
+                         : a->first < b->first;
+                 });
+    for (size_t i = 0; i < field_count; ++i) {
+        SnapshotField& item = snapshot.fields[snapshot.field_count++];
+        copy_text(item.key, fields[i]->first);
+        item.count = fields[i]->second.count;
+        item.sum = fields[i]->second.sum;
+    }
+    snapshot.dropped_fields = stats.dropped_fields;
+
+    const time_t clients_now = stats.clients.last_update();
+    for (const ClientStats* client : stats.clients.top(SNAPSHOT_CLIENTS)) {
+        SnapshotClient& item = snapshot.clients[snapshot.client_count++];
+        copy_text(item.source, client->source);
+        item.total = client->total;
+        item.low = client->by_importance[0];
+        item.medium = client->by_importance[1];
+        item.high = client->by_importance[2];
+        item.bytes = client->bytes;
+        item.rate = client->rate(clients_now);
+    }
+    snapshot.clients_active = stats.clients.size();
+    snapshot.clients_evicted = stats.clients.evicted();
+    return snapshot;
+}
+
+string format_snapshot_json(const StatsSnapshot& snapshot) {
+    ostringstream out;
+    out << "{\"timestamp\":" << snapshot.timestamp
+        << ",\"total\":" << snapshot.total
+        << ",\"by_importance\":{\"LOW\":" << snapshot.low
+        << ",\"MEDIUM\":" << snapshot.medium
+        << ",\"HIGH\":" << snapshot.high << "}"
+        << ",\"last_hour\":" << snapshot.last_hour
+        << ",\"min_len\":" << snapshot.min_len
+        << ",\"max_len\":" << snapshot.max_len
+        << ",\"avg_len\":" << snapshot.avg_len
+        << ",\"distinct_templates\":" << snapshot.distinct_templates
+        << ",\"distinct_sources\":" << snapshot.distinct_sources
+        << ",\"window_templates\":" << snapshot.window_templates
+        << ",\"window_sources\":" << snapshot.window_sources;
+
+    out << ",\"top_templates\":[";
+    for (uint32_t i = 0; i < snapshot.template_count; ++i) {
+        const SnapshotTemplate& item = snapshot.templates[i];
+        out << (i ? "," : "") << "{\"template\":";
+        write_json_string(out, item.text);
+        out << ",\"count\":" << item.count << ",\"error\":" << item.error << "}";
+    }
+
+    // Сумма выводится только для числовых полей (ключ без '=')
+    out << "],\"fields\":[";
+    for (uint32_t i = 0; i < snapshot.field_count; ++i) {
+        const SnapshotField& item = snapshot.fields[i];
+        out << (i ? "," : "") << "{\"key\":";
+        write_json_string(out, item.key);
+        out << ",\"count\":" << item.count;
+        if (!strchr(item.key, '=')) {
+            out << ",\"sum\":" << item.sum;
+        }
+        out << "}";
+    }
+    out << "],\"dropped_fields\":" << snapshot.dropped_fields;
+
+    out << ",\"clients\":{\"active\":" << snapshot.clients_active
+        << ",\"evicted\":" << snapshot.clients_evicted << ",\"top\":[";
+    for (uint32_t i = 0; i < snapshot.client_count; ++i) {
+        const SnapshotClient& item = snapshot.clients[i];
+        out << (i ? "," : "") << "{\"source\":";
+        write_json_string(out, item.source);
+        out << ",\"total\":" << item.total
+            << ",\"by_importance\":{\"LOW\":" << item.low
+            << ",\"MEDIUM\":" << item.medium
+            << ",\"HIGH\":" << item.high << "}"
+            << ",\"bytes\":" << item.bytes
+            << ",\"rate\":" << item.rate << "}";
+    }
+    out << "]}}\n";
+    return out.str();
+}
+
+SnapshotServer::SnapshotServer(int port, const Seqlock<StatsSnapshot>& snapshot)
+    : m_snapshot(snapshot) {
+    m_listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_socket == -1) {
+        throw runtime_error("Query socket creation failed: " + string(strerror(errno)));
+    }
+
+    int opt = 1;
+    setsockopt(m_listen_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(m_listen_socket, (sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(m_listen_socket, SOMAXCONN) == -1) {
+        string error = strerror(errno);
+        close(m_listen_socket);
+        throw runtime_error("Query port setup failed: " + error);
+    }
+
+    m_thread = thread(&SnapshotServer::serve, this);
+}
+
+SnapshotServer::~SnapshotServer() {
+    m_running = false;
+    shutdown(m_listen_socket, SHUT_RDWR); // Прерывает ожидание в accept
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    close(m_listen_socket);
+}
+
+void SnapshotServer::serve() {
+    while (m_running) {
+        int client = accept(m_listen_socket, nullptr, nullptr);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break; // Сокет закрыт при остановке
+        }
+
+        string response = format_snapshot_json(m_snapshot.load());
+        send(client, response.data(), response.size(), MSG_NOSIGNAL);
+        close(client);
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include "stats_lib.hpp"
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Ограничения снимка: число частых шаблонов, полей и клиентов
+// и длина текста (длинные шаблоны и ключи обрезаются)
+constexpr size_t SNAPSHOT_TEMPLATES = TOP_K_REPORT;
+constexpr size_t SNAPSHOT_FIELDS = 16;
+constexpr size_t SNAPSHOT_CLIENTS = CLIENT_REPORT;
+constexpr size_t SNAPSHOT_TEXT_LEN = 128;
+
+// Частый шаблон сообщения
+struct SnapshotTemplate {
+    char text[SNAPSHOT_TEXT_LEN];
+    uint64_t count;
+    uint64_t error; // Верхняя граница переоценки
+};
+
+// Агрегат структурированного поля ("key" или "key=value", см. MessageStats)
+struct SnapshotField {
+    char key[SNAPSHOT_TEXT_LEN];
+    uint64_t count;
+    double sum; // Только для числовых полей
+};
+
+// Строка таблицы клиентов
+struct SnapshotClient {
+    char source[MAX_SOURCE_LEN + 1];
+    uint64_t total;
+    uint64_t low;
+    uint64_t medium;
+    uint64_t high;
+    uint64_t bytes;
+    double rate; // Сообщений в секунду
+};
+
+// Снимок статистики для внешних запросов (только тривиально копируемые поля).
+// Шаблоны, поля и клиенты хранятся в массивах фиксированного размера:
+// самые частые шаблоны, самые частые поля и самые активные клиенты
+struct StatsSnapshot {
+    int64_t timestamp = 0; // Время формирования снимка
+    uint64_t total = 0;
+    uint64_t low = 0;
+    uint64_t medium = 0;
+    uint64_t high = 0;
+    uint64_t last_hour = 0;
+    uint64_t min_len = 0;
+    uint64_t max_len = 0;
+    double avg_len = 0.0;
+    double distinct_templates = 0.0;
+    double distinct_sources = 0.0;
+    double window_templates = 0.0;
+    double window_sources = 0.0;
+
+    uint32_t template_count = 0;
+    SnapshotTemplate templates[SNAPSHOT_TEMPLATES]{};
+    uint32_t field_count = 0;
+    uint64_t dropped_fields = 0;
+    SnapshotField fields[SNAPSHOT_FIELDS]{};
+    uint32_t client_count = 0;
+    uint64_t clients_active = 0;
+    uint64_t clients_evicted = 0;
+    SnapshotClient clients[SNAPSHOT_CLIENTS]{};
+};
+
+// Публикация значения одним писателем для множества читателей (seqlock).
+// Писатель никогда не ждет читателей, читатель повторяет чтение,
+// если попал на момент записи. Данные хранятся в атомарных словах,
+// поэтому одновременное чтение и запись не являются гонкой данных
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable_v<T>, "Seqlock requires trivially copyable type");
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+    Seqlock() { store(T{}); }
+
+    // Вызывается только из одного потока
+    void store(const T& value) {
+        uint64_t buf[WORDS] = {};
+        std::memcpy(buf, &value, sizeof(T));
+        const uint64_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed); // Нечетное - идет запись
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) {
+            m_data[i].store(buf[i], std::memory_order_relaxed);
+        }
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        uint64_t buf[WORDS];
+        while (true) {
+            const uint64_t before = m_seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < WORDS; ++i) {
+                buf[i] = m_data[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_seq.load(std::memory_order_relaxed) == before) {
+                break;
+            }
+        }
+        T value;
+        std::memcpy(&value, buf, sizeof(T));
+        return value;
+    }
+
+private:
+    std::atomic<uint64_t> m_seq{0};
+    std::atomic<uint64_t> m_data[WORDS];
+};
+
+// Формирование снимка (берет stats_mutex на время копирования счетчиков)
+StatsSnapshot make_snapshot(MessageStats& stats, time_t now);
+
+// Снимок в виде одной строки JSON
+std::string format_snapshot_json(const StatsSnapshot& snapshot);
+
+// Сервер запросов: на каждое подключение отдает текущий снимок в JSON
+// и закрывает соединение. Работает в отдельном потоке и читает снимок
+// без блокировок, поэтому частые запросы не замедляют прием сообщений
+class SnapshotServer {
+public:
+    SnapshotServer(int port, const Seqlock<StatsSnapshot>& snapshot);
+    ~SnapshotServer();
+
+    SnapshotServer(const SnapshotServer&) = delete;
+    SnapshotServer& operator=(const SnapshotServer&) = delete;
+
+private:
+    void serve();
+
+    const Seqlock<StatsSnapshot>& m_snapshot;
+    int m_listen_socket = -1;
+    std::atomic<bool> m_running{true};
+    std::thread m_thread;
+};
@@ -0,0 +1,139 @@
+#include "stats_sketches.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+void normalize_template(string_view text, string& out) {
+    out.clear();
+
+    // Пропускаем префикс "[время] [УРОВЕНЬ] ", если он есть
+    if (!text.empty() && text[0] == '[') {
+        size_t first = text.find("] [");
+        if (first != string_view::npos) {
+            size_t second = text.find("] ", first + 3);
+            if (second != string_view::npos) {
+                text.remove_prefix(second + 2);
+            }
+        }
+    }
+
+    bool in_number = false;
+    for (char c : text) {
+        if (out.size() >= MAX_TEMPLATE_LEN) break;
+        if (isdigit(static_cast<unsigned char>(c))) {
+            if (!in_number) out += '#';
+            in_number = true;
+        } else {
+            out += c;
+            in_number = false;
+        }
+    }
+}
+
+TopK::TopK(size_t capacity) : m_capacity(capacity) {
+    m_entries.reserve(capacity);
+    m_index.reserve(capacity);
+}
+
+void TopK::add(const string& key) {
+    if (m_capacity == 0) return;
+
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_entries[it->second].count++;
+        return;
+    }
+
+    if (m_entries.size() < m_capacity) {
+        m_index.emplace(key, m_entries.size());
+        m_entries.push_back({key, 1, 0});
+        return;
+    }
+
+    // Вытесняем элемент с минимальным счетчиком, наследуя его значение
+    auto min_it = min_element(m_entries.begin(), m_entries.end(),
+        [](const Entry& a, const Entry& b) { return a.count < b.count; });
+    size_t pos = static_cast<size_t>(min_it - m_entries.begin());
+    m_index.erase(min_it->key);
+    min_it->error = min_it->count;
+    min_it->count++;
+    min_it->key = key;
+    m_index.emplace(key, pos);
+}
+
+vector<TopK::Entry> TopK::top(size_t n) const {
+    vector<Entry> result(m_entries);
+    sort(result.begin(), result.end(),
+         [](const Entry& a, const Entry& b) { return a.count > b.count; });
+    if (result.size() > n) {
+        result.resize(n);
+    }
+    return result;
+}
+
+uint64_t hash_string(string_view data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    // Финализатор MurmurHash3: выравнивает распределение старших битов
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+HyperLogLog::HyperLogLog(unsigned precision) : m_precision(precision) {
+    if (precision < 4 || precision > 18) {
+        throw invalid_argument("HyperLogLog precision must be in [4, 18]");
+    }
+    m_registers.assign(size_t(1) << precision, 0);
+}
+
+void HyperLogLog::add_hash(uint64_t hash) {
+    // Старшие биты выбирают регистр, в остальных ищем позицию первой единицы
+    size_t index = hash >> (64 - m_precision);
+    uint64_t rest = (hash << m_precision) | (uint64_t(1) << (m_precision - 1));
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    if (rank > m_registers[index]) {
+        m_registers[index] = rank;
+    }
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.m_precision != m_precision) {
+        throw invalid_argument("Cannot merge HyperLogLog with different precision");
+    }
+    for (size_t i = 0; i < m_registers.size(); ++i) {
+        m_registers[i] = max(m_registers[i], other.m_registers[i]);
+    }
+}
+
+void HyperLogLog::clear() {
+    fill(m_registers.begin(), m_registers.end(), 0);
+}
+
+double HyperLogLog::estimate() const {
+    const double m = static_cast<double>(m_registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t reg : m_registers) {
+        sum += ldexp(1.0, -reg);
+        if (reg == 0) zeros++;
+    }
+
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+
+    // Поправка для малых значений: линейный подсчет по пустым регистрам
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / static_cast<double>(zeros));
+    }
+    return estimate;
+}
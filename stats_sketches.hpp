@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+// Максимальная длина нормализованного шаблона сообщения
+constexpr size_t MAX_TEMPLATE_LEN = 96;
+
+// Приведение сообщения к шаблону: отбрасываются метка времени и уровень,
+// последовательности цифр заменяются на '#', длина ограничивается MAX_TEMPLATE_LEN.
+// Результат пишется в out, чтобы буфер переиспользовался между вызовами
+void normalize_template(std::string_view text, std::string& out);
+
+// Поиск самых частых элементов (heavy hitters) алгоритмом Space-Saving.
+// Хранит не более capacity счетчиков, поэтому память не растет
+// с числом различных сообщений. Оценка count завышена не более чем на error
+class TopK {
+public:
+    struct Entry {
+        std::string key;
+        size_t count = 0;
+        size_t error = 0; // Верхняя граница переоценки
+    };
+
+    explicit TopK(size_t capacity);
+
+    void add(const std::string& key);
+    // Самые частые элементы по убыванию счетчика
+    std::vector<Entry> top(size_t n) const;
+    size_t capacity() const { return m_capacity; }
+
+private:
+    size_t m_capacity;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, size_t> m_index; // Ключ -> позиция в m_entries
+};
+
+// 64-битный хеш строки (FNV-1a с финальным перемешиванием)
+uint64_t hash_string(std::string_view data);
+
+// Оценка числа различных элементов (HyperLogLog).
+// Память фиксирована: 2^precision однобайтовых регистров
+// (4 КБ при precision = 12, относительная ошибка ~1.04 / sqrt(2^precision) = 1.6%).
+// Оценки с одинаковой точностью объединяются через merge, что позволяет
+// считать по частям (шардам) и складывать результат
+class HyperLogLog {
+public:
+    explicit HyperLogLog(unsigned precision = 12);
+
+    void add(std::string_view item) { add_hash(hash_string(item)); }
+    void add_hash(uint64_t hash);
+    void merge(const HyperLogLog& other);
+    void clear();
+    double estimate() const;
+    unsigned precision() const { return m_precision; }
+
+private:
+    unsigned m_precision;
+    std::vector<uint8_t> m_registers;
+};
@@ -1,6 +1,13 @@
-#include "journal_lib.hpp"
+#include "log_manager.hpp"
+#include "shm_ring.hpp"
+#include "log_router.hpp"
+#include "sharded_output.hpp"
+#include "log_async.hpp"
+#include "mapped_output.hpp"
+#include "rotating_output.hpp"
 #include <cassert>
 #include <fstream>
+#include <sstream>
 #include <filesystem>
 #include <thread>
 #include <chrono>
@@ -8,9 +15,39 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef JOURNAL_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 using namespace std;
 
+// Счетчик выделений памяти во всей программе (для проверки пулов буферов)
+static atomic<size_t> g_allocations(0);
+
+void* operator new(size_t size) {
+    g_allocations++;
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
 // Вспомогательная функция для чтения последней строки файла
 string read_last_line(const string& filename) {
     ifstream file(filename);
@@ -167,6 +204,1208 @@ void test_empty_priority() {
     clear_test_file(test_file);
 }
 
+// Test 8: Структурированные поля ключ/значение
+void test_structured_fields() {
+    const string test_file = "test_fields.log";
+    clear_test_file(test_file);
+    
+    {
+        Journal_logger logger(test_file, importances::LOW);
+        string user = "alice";
+        logger.message_log("Request done", importances::MEDIUM,
+                           {{"status", 200}, {"latency", 1.5}, {"user", user}});
+    }
+    
+    string line = read_last_line(test_file);
+    assert(line.find("[MEDIUM] Request done") != string::npos);
+    
+    // Поля выделяются из записи по разделителю, без разбора текста
+    vector<ParsedLogField> fields;
+    string_view text = for_each_log_field(line, [&fields](const ParsedLogField& field) {
+        fields.push_back(field);
+    });
+    assert(text.find("Request done") != string_view::npos);
+    assert(text.find(LOG_FIELD_SEPARATOR) == string_view::npos);
+    assert(fields.size() == 3);
+    assert(fields[0].key == "status" && fields[0].type == LogField::Type::INT);
+    assert(fields[0].value == "200");
+    assert(fields[1].key == "latency" && fields[1].type == LogField::Type::DOUBLE);
+    assert(fields[1].value == "1.5");
+    assert(fields[2].key == "user" && fields[2].type == LogField::Type::STRING);
+    assert(fields[2].value == "alice");
+    clear_test_file(test_file);
+
+    // Разделитель в тексте и в значении поля не порождает лишних полей
+    {
+        Journal_logger logger(test_file, importances::LOW);
+        logger.message_log("Text\x1Fsinjected=1", importances::MEDIUM,
+                           {{"user", "bob\x1Fsrole=admin"}});
+    }
+    line = read_last_line(test_file);
+    fields.clear();
+    text = for_each_log_field(line, [&fields](const ParsedLogField& field) {
+        fields.push_back(field);
+    });
+    assert(text.find("Text sinjected=1") != string_view::npos);
+    assert(fields.size() == 1);
+    assert(fields[0].key == "user" && fields[0].value == "bob srole=admin");
+    clear_test_file(test_file);
+
+    // Перевод строки в тексте не разбивает запись на две (получатель
+    // сокета делит поток по '\n')
+    {
+        Journal_logger logger(test_file, importances::LOW);
+        logger.message_log("First line\nsecond\r\nthird", importances::HIGH);
+    }
+    {
+        ifstream file(test_file);
+        string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        assert(count(content.begin(), content.end(), '\n') == 1);
+        assert(content.find("[HIGH] First line second  third\n") != string::npos);
+    }
+    clear_test_file(test_file);
+
+    // Поля через LogManager: кодируются при вызове log, поэтому строка
+    // значения может быть разрушена до форматирования
+    {
+        LogManager manager(make_unique<FileLogger>(test_file, importances::LOW), 2);
+        manager.start();
+        {
+            string request = "req-42";
+            manager.log("Queued request", importances::HIGH,
+                        {{"request", request}, {"attempt", 3}});
+        }
+        manager.log("Synced\x1F", importances::LOW, Durability::SYNCED, nullptr,
+                    {{"bytes", 1024}});
+        manager.stop();
+    }
+    vector<string> lines;
+    {
+        ifstream file(test_file);
+        while (getline(file, line)) {
+            lines.push_back(line);
+        }
+    }
+    assert(lines.size() == 2);
+    fields.clear();
+    text = for_each_log_field(lines[0], [&fields](const ParsedLogField& field) {
+        fields.push_back(field);
+    });
+    assert(text.find("[HIGH] Queued request") != string_view::npos);
+    assert(fields.size() == 2);
+    assert(fields[0].key == "request" && fields[0].value == "req-42");
+    assert(fields[1].key == "attempt" && fields[1].type == LogField::Type::INT);
+    assert(fields[1].value == "3");
+    fields.clear();
+    text = for_each_log_field(lines[1], [&fields](const ParsedLogField& field) {
+        fields.push_back(field);
+    });
+    assert(text.find("Synced ") != string_view::npos);
+    assert(fields.size() == 1 && fields[0].key == "bytes" && fields[0].value == "1024");
+
+    clear_test_file(test_file);
+}
+
+// Test 9: Пакетный прием строк с необязательным префиксом уровня
+void test_batch_ingest() {
+    const string input_file = "test_batch_input.txt";
+    const string test_file = "test_batch.log";
+    clear_test_file(input_file);
+    clear_test_file(test_file);
+    
+    {
+        ofstream input(input_file);
+        input << "[HIGH] first\n"
+              << "plain second\r\n"
+              << "\n"                  // Пустая строка пропускается
+              << "[LOW] dropped\n"      // Ниже уровня по умолчанию
+              << "[MEDIUM]third";      // Последняя строка без перевода строки
+    }
+    
+    {
+        LogManager manager(make_unique<FileLogger>(test_file, importances::MEDIUM));
+        manager.start();
+        int fd = open(input_file.c_str(), O_RDONLY);
+        assert(fd != -1);
+        size_t count = ingest_batch(fd, manager, importances::MEDIUM);
+        close(fd);
+        assert(count == 4);
+        manager.stop(); // Все поставленные в очередь записи дописываются
+        
+        // После остановки пачка отклоняется, уведомления получают false
+        fd = open(input_file.c_str(), O_RDONLY);
+        assert(ingest_batch(fd, manager, importances::MEDIUM) == 0);
+        close(fd);
+        vector<LogQueue::Task> late;
+        late.push_back({"late", importances::HIGH, time(nullptr)});
+        int rejected = 0;
+        late.back().durability = Durability::WRITTEN;
+        late.back().done = [&rejected](bool ok) { if (!ok) rejected++; };
+        assert(manager.log_batch(late) == 0);
+        assert(late.empty() && rejected == 1);
+    }
+    
+    ifstream file(test_file);
+    vector<string> lines;
+    string line;
+    while (getline(file, line)) {
+        lines.push_back(line);
+    }
+    assert(lines.size() == 3);
+    assert(lines[0].find("[HIGH] first") != string::npos);
+    assert(lines[1].find("[MEDIUM] plain second") != string::npos);
+    assert(lines[1].back() != '\r');
+    assert(lines[2].find("[MEDIUM] third") != string::npos);
+    
+    clear_test_file(input_file);
+    clear_test_file(test_file);
+}
+
+// Test 10: Пул потоков форматирования сохраняет порядок записей
+void test_format_workers_order() {
+    const string test_file = "test_workers.log";
+    clear_test_file(test_file);
+    
+    const int message_count = 2000;
+    {
+        LogManager manager(make_unique<FileLogger>(test_file, importances::MEDIUM), 4);
+        manager.start();
+        for (int i = 0; i < message_count; ++i) {
+            // Отфильтрованные записи не должны нарушать порядок остальных
+            manager.log("Message " + to_string(i), 
+                        i % 3 == 0 ? importances::LOW : importances::HIGH);
+        }
+        manager.stop();
+    }
+    
+    ifstream file(test_file);
+    string line;
+    int expected = 0;
+    while (getline(file, line)) {
+        while (expected % 3 == 0) expected++;
+        string tail = "Message " + to_string(expected);
+        assert(line.size() >= tail.size());
+        assert(line.compare(line.size() - tail.size(), tail.size(), tail) == 0);
+        expected++;
+    }
+    while (expected % 3 == 0) expected++;
+    assert(expected >= message_count);
+    clear_test_file(test_file);
+}
+
+// Test 11: Запись в установившемся режиме не выделяет память
+void test_steady_state_allocations() {
+    const string test_file = "test_alloc.log";
+    clear_test_file(test_file);
+    
+    // Сообщения длиннее SSO-буфера std::string, чтобы копия требовала кучи
+    vector<string> messages;
+    for (int i = 0; i < 500; ++i) {
+        messages.push_back("Steady state message number " + to_string(i));
+    }
+    
+    {
+        LogManager manager(make_unique<FileLogger>(test_file, importances::LOW), 2);
+        manager.start();
+        auto burst = [&manager, &messages]() {
+            for (const string& message : messages) {
+                manager.log(message, importances::MEDIUM);
+            }
+            manager.flush();
+        };
+        
+        burst(); // Прогрев (первое обращение к часовому поясу и т.п.)
+        size_t before = g_allocations;
+        for (int i = 0; i < 10; ++i) {
+            burst();
+        }
+        size_t after = g_allocations;
+        manager.stop();
+        
+        assert(after == before);
+    }
+    
+    ifstream file(test_file);
+    int line_count = count(istreambuf_iterator<char>(file), istreambuf_iterator<char>(), '\n');
+    assert(line_count == 11 * 500);
+    clear_test_file(test_file);
+}
+
+// Test 12: Кольцо в общей памяти: несколько писателей, порядок и содержимое
+void test_shm_ring() {
+    const string name = "/journal_test_ring_" + to_string(getpid());
+    // Маленькое кольцо, чтобы записи многократно переходили через границу
+    ShmRing reader = ShmRing::create(name, 4096);
+    
+    const int producers = 2;
+    const int per_producer = 5000;
+    vector<thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&name, p]() {
+            ShmRing writer = ShmRing::open(name);
+            for (int i = 0; i < per_producer; ++i) {
+                // Разная длина записей, чтобы смещения не повторялись
+                string record = "P" + to_string(p) + " " + to_string(i) + " " + string(i % 37, 'x');
+                writer.push(record, 5000);
+            }
+        });
+    }
+    
+    vector<int> next(producers, 0);
+    int received = 0;
+    // Ожидание короткими интервалами, как в stats_collector: на одном
+    // процессоре долгий сон читателя может задержать вытесненного писателя
+    // вплоть до его собственного таймаута
+    int idle = 0;
+    while (received < producers * per_producer && idle < 100) {
+        if (!reader.wait(100)) {
+            ++idle;
+            continue;
+        }
+        idle = 0;
+        received += reader.consume([&next](string_view record) {
+            assert(record.size() > 1 && record[0] == 'P');
+            int p = record[1] - '0';
+            size_t space = record.find(' ', 3);
+            int i = stoi(string(record.substr(3, space - 3)));
+            assert(i == next[p]);
+            assert(record.size() == space + 1 + i % 37);
+            next[p]++;
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    
+    assert(received == producers * per_producer);
+    for (int p = 0; p < producers; ++p) {
+        assert(next[p] == per_producer);
+    }
+    
+    // Заполненное кольцо при живом читателе: ожидание места ограничено
+    {
+        ShmRing writer = ShmRing::open(name);
+        auto start = chrono::steady_clock::now();
+        bool full = false;
+        try {
+            for (int i = 0; i < 1000; ++i) {
+                assert(writer.push(string(100, 'f'), 100));
+            }
+        } catch (const runtime_error&) {
+            full = true;
+        }
+        assert(full);
+        assert(chrono::steady_clock::now() - start < chrono::seconds(2));
+    }
+    
+    // Пересоздание сегмента (перезапуск коллектора): старый закрыт,
+    // вывод отключается один раз и затем подключается к новому
+    ShmRingOutput output(name);
+    assert(output.is_connected());
+    reader = ShmRing::create(name, 4096);
+    assert(!output.is_connected());
+    bool reported = false;
+    try {
+        output.write("to old ring");
+    } catch (const runtime_error&) {
+        reported = true;
+    }
+    assert(reported);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        output.write("dropped"); // Без ожидания и исключений
+    }
+    assert(chrono::steady_clock::now() - start < chrono::milliseconds(500));
+    assert(output.dropped() == 1001);
+    this_thread::sleep_for(chrono::milliseconds(1100));
+    output.write("to new ring");
+    assert(output.is_connected());
+    vector<string> records;
+    reader.consume([&records](string_view record) { records.emplace_back(record); });
+    assert(records.size() == 1 && records[0] == "to new ring");
+    
+    // Читатель ушел (деструктор отмечает сегмент закрытым)
+    reader.unlink();
+    reader = ShmRing::create(name + "_other", 4096);
+    assert(!output.is_connected());
+    reader.unlink();
+    
+    // Читатель завершился аварийно, не закрыв сегмент
+    pid_t child = fork();
+    if (child == 0) {
+        ShmRing crashed = ShmRing::create(name, 4096);
+        _exit(0); // Без деструкторов
+    }
+    waitpid(child, nullptr, 0);
+    {
+        ShmRing writer = ShmRing::open(name);
+        assert(!writer.reader_alive());
+        bool pushed = true;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < 1000 && pushed; ++i) {
+            pushed = writer.push(string(100, 'c'));
+        }
+        assert(!pushed); // Кольцо заполнилось, ждать некого
+        assert(chrono::steady_clock::now() - start < chrono::milliseconds(500));
+        writer.unlink();
+    }
+}
+
+// Test 13: Маршрутизация: первое подходящее правило, уровни, отбрасывание
+void test_routing_rules() {
+    istringstream routes(
+        "# errors - отдельный файл\n"
+        "sink errors test_route_errors.log\n"
+        "HIGH errors,file timeout|refused\n"
+        "LOW-MEDIUM drop heartbeat | she\n"
+        "* errors hers\n"
+        "MEDIUM file\n"
+    );
+    RouteConfig config = parse_route_config(routes, {"file"});
+    const LogRouter& router = config.router;
+    assert(config.file_sinks.size() == 1);
+    assert(config.file_sinks[0].second == "test_route_errors.log");
+    assert(router.rule_count() == 4);
+    
+    const RouteMask file = 1, errors = 2;
+    assert(router.route("connection refused", importances::HIGH) == (file | errors));
+    assert(router.route("connection refused", importances::LOW) == file); // Маршрут по умолчанию
+    assert(router.route("heartbeat ok", importances::LOW) == ROUTE_DROP);
+    assert(router.route("heartbeat ok", importances::HIGH) == file);
+    // Вложенные подстроки: "she" и "hers" оканчиваются в разных позициях,
+    // побеждает правило с меньшим номером
+    assert(router.route("ushers", importances::LOW) == ROUTE_DROP);
+    assert(router.route("ushers", importances::HIGH) == errors);
+    assert(router.route("nothing", importances::MEDIUM) == file);
+
+    // Образцы со всеми 256 значениями байта: у каждого байта свой класс
+    PatternMatcher matcher;
+    string all_bytes;
+    for (int c = 0; c < 256; ++c) {
+        all_bytes += static_cast<char>(c);
+    }
+    matcher.add(all_bytes, 1);
+    matcher.add("\xFF\x01", 2);
+    matcher.add(string("\x00\xFF", 2), 3);
+    matcher.build();
+    auto matches = [&matcher](string_view text) {
+        vector<uint32_t> found;
+        matcher.scan(text, [&found](const uint32_t* begin, const uint32_t* end) {
+            found.insert(found.end(), begin, end);
+            return true;
+        });
+        return found;
+    };
+    assert((matches("a\xFF\x01") == vector<uint32_t>{2}));
+    assert((matches(string("\x00\xFF\x01", 3)) == vector<uint32_t>{3, 2}));
+    assert(matches("\xFF\xFF\x02\x01").empty());
+    assert((matches(all_bytes + "\x01") == vector<uint32_t>{1, 2}));
+    
+    // Ошибка разбора сообщает номер строки
+    istringstream bad("HIGH nowhere timeout\n");
+    bool thrown = false;
+    try {
+        parse_route_config(bad, {"file"});
+    } catch (const invalid_argument& e) {
+        thrown = string(e.what()).find("line 1") != string::npos;
+    }
+    assert(thrown);
+    
+    // Запись через LogManager в два файла
+    const string main_file = "test_route_main.log";
+    const string errors_file = config.file_sinks[0].second;
+    clear_test_file(main_file);
+    clear_test_file(errors_file);
+    {
+        vector<RoutingLogger::Sink> sinks;
+        sinks.push_back({"file", make_unique<Journal_logger>(main_file, importances::LOW)});
+        sinks.push_back({"errors", make_unique<Journal_logger>(errors_file, importances::LOW)});
+        LogManager manager(make_unique<RoutingLogger>(move(sinks), config.router), 2);
+        manager.start();
+        manager.log("heartbeat 1", importances::LOW);
+        manager.log("request timeout", importances::HIGH);
+        manager.log("user login", importances::MEDIUM);
+        manager.stop();
+    }
+    
+    auto read_lines = [](const string& filename) {
+        ifstream file(filename);
+        vector<string> lines;
+        string line;
+        while (getline(file, line)) {
+            lines.push_back(line);
+        }
+        return lines;
+    };
+    vector<string> main_lines = read_lines(main_file);
+    vector<string> error_lines = read_lines(errors_file);
+    assert(main_lines.size() == 2);
+    assert(main_lines[0].find("request timeout") != string::npos);
+    assert(main_lines[1].find("user login") != string::npos);
+    assert(error_lines.size() == 1);
+    assert(error_lines[0].find("[HIGH] request timeout") != string::npos);
+    clear_test_file(main_file);
+    clear_test_file(errors_file);
+    
+    // Отказ одного из выводов: остальные получают запись, а уведомление
+    // WRITTEN приходит с false
+    class FailingOutput : public LogOutput {
+    public:
+        void write(const string&) override { throw runtime_error("disk full"); }
+        bool is_connected() const override { return true; }
+    };
+    {
+        vector<RoutingLogger::Sink> sinks;
+        sinks.push_back({"file", make_unique<Journal_logger>(make_unique<FailingOutput>(),
+                                                              importances::LOW)});
+        sinks.push_back({"errors", make_unique<Journal_logger>(errors_file, importances::LOW)});
+        LogManager manager(make_unique<RoutingLogger>(move(sinks), config.router), 2);
+        manager.start();
+        atomic<int> succeeded{0}, failed{0};
+        auto done = [&](bool ok) { ok ? succeeded++ : failed++; };
+        manager.log("request timeout", importances::HIGH, Durability::WRITTEN, done);
+        manager.log("disk hers", importances::LOW, Durability::WRITTEN, done); // Только errors
+        manager.flush();
+        manager.stop();
+        assert(failed == 1 && succeeded == 1);
+    }
+    assert(read_lines(errors_file).size() == 2);
+    clear_test_file(errors_file);
+}
+
+// Логгер с медленным выводом: запоминает порядок записей
+class SlowLogger : public ILogger {
+public:
+    explicit SlowLogger(vector<string>& written) : m_written(written) {}
+    importances get_default_importance() const override { return importances::LOW; }
+    bool format(const string& message, importances, time_t, string_view, string& out) const override {
+        out = message;
+        return true;
+    }
+    void write(const string& record) override {
+        this_thread::sleep_for(chrono::microseconds(500));
+        m_written.push_back(record);
+    }
+
+private:
+    vector<string>& m_written;
+};
+
+// Позиция записи в порядке вывода
+size_t written_position(const vector<string>& written, const string& record) {
+    return find(written.begin(), written.end(), record) - written.begin();
+}
+
+// Test 14: Полосы очереди: HIGH обходит накопившиеся LOW
+void test_priority_lanes() {
+    const int flood = 300;
+    auto run = [flood](LanePolicy policy, vector<string>& written) {
+        LaneOptions options;
+        options.policy = policy;
+        options.dispatch_window = 4;
+        options.starvation_limit = 8;
+        LogManager manager(make_unique<SlowLogger>(written), 1);
+        manager.set_lane_options(options);
+        manager.start();
+        for (int i = 0; i < flood; ++i) {
+            manager.log("low " + to_string(i), importances::LOW);
+        }
+        manager.log("urgent", importances::HIGH);
+        for (int i = 0; i < 20; ++i) {
+            manager.log("high " + to_string(i), importances::HIGH);
+        }
+        manager.flush(); // Ожидает все полосы
+        assert(written.size() == static_cast<size_t>(flood + 21));
+        manager.stop();
+    };
+    
+    // FIFO: HIGH ждет всех LOW, поступивших раньше
+    vector<string> fifo;
+    run(LanePolicy::FIFO, fifo);
+    assert(written_position(fifo, "urgent") == static_cast<size_t>(flood));
+    
+    // STRICT: HIGH выводится сразу после записей, уже выбранных из очереди
+    vector<string> strict;
+    run(LanePolicy::STRICT, strict);
+    size_t urgent = written_position(strict, "urgent");
+    assert(urgent < 20);
+    // Защита от голодания: среди HIGH не больше starvation_limit подряд
+    size_t run_length = 0;
+    for (size_t i = urgent; i < urgent + 21; ++i) {
+        run_length = strict[i].compare(0, 4, "low ") == 0 ? 0 : run_length + 1;
+        assert(run_length <= 9);
+    }
+    // Внутри полосы порядок сохраняется
+    int previous = -1;
+    for (const string& record : strict) {
+        if (record.compare(0, 4, "low ") != 0) continue;
+        int index = stoi(record.substr(4));
+        assert(index == previous + 1);
+        previous = index;
+    }
+    
+    // WEIGHTED: HIGH получает большую долю, LOW продолжают выводиться
+    vector<string> weighted;
+    run(LanePolicy::WEIGHTED, weighted);
+    assert(written_position(weighted, "urgent") < 20);
+    assert(written_position(weighted, "high 19") < 60);
+}
+
+// Логгер, выводящий сообщения без форматирования в LogOutput
+class OutputLogger : public ILogger {
+public:
+    explicit OutputLogger(unique_ptr<LogOutput> output) : m_output(move(output)) {}
+    importances get_default_importance() const override { return importances::LOW; }
+    bool format(const string& message, importances, time_t, string_view, string& out) const override {
+        out = message;
+        return true;
+    }
+    void write(const string& record) override { m_output->write(record); }
+
+private:
+    unique_ptr<LogOutput> m_output;
+};
+
+// Test 15: Сегменты по источникам записей и их слияние по времени
+void test_sharded_output() {
+    const string base = "test_sharded.log";
+    auto cleanup = [&base] {
+        for (const string& shard : find_journal_shards(base)) {
+            filesystem::remove(shard);
+        }
+    };
+    cleanup();
+    
+    // Каждый поток пишет в свой сегмент
+    const int threads = 4;
+    const int per_thread = 2000;
+    {
+        auto output = make_unique<ShardedFileOutput>(base);
+        ShardedFileOutput* sharded = output.get();
+        Journal_logger logger(move(output), importances::LOW);
+        vector<thread> producers;
+        for (int t = 0; t < threads; ++t) {
+            producers.emplace_back([&logger, t] {
+                for (int i = 0; i < per_thread; ++i) {
+                    logger.message_log("thread " + to_string(t) + " record " + to_string(i),
+                                       importances::MEDIUM);
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        assert(sharded->shard_count() == static_cast<size_t>(threads));
+    }
+    vector<string> shards = find_journal_shards(base);
+    assert(shards.size() == static_cast<size_t>(threads));
+    
+    // Слияние: все записи, порядок внутри потока сохранен, префиксов нет
+    stringstream merged;
+    assert(merge_journal_shards(shards, merged) == static_cast<size_t>(threads * per_thread));
+    vector<int> next(threads, 0);
+    string line;
+    size_t lines = 0;
+    while (getline(merged, line)) {
+        assert(line.compare(0, 1, "[") == 0);
+        size_t pos = line.find("thread ");
+        assert(pos != string::npos);
+        int t = stoi(line.substr(pos + 7));
+        int i = stoi(line.substr(line.find("record ", pos) + 7));
+        assert(i == next[t]);
+        next[t]++;
+        lines++;
+    }
+    assert(lines == static_cast<size_t>(threads * per_thread));
+    cleanup();
+
+    // Через LogManager сегмент выбирается по потоку, вызвавшему log,
+    // а не по потоку записи
+    {
+        auto output = make_unique<ShardedFileOutput>(base);
+        ShardedFileOutput* sharded = output.get();
+        LogManager manager(make_unique<OutputLogger>(move(output)), 2);
+        manager.start();
+        vector<thread> producers;
+        for (int t = 0; t < threads; ++t) {
+            producers.emplace_back([&manager, t] {
+                for (int i = 0; i < per_thread; ++i) {
+                    manager.log("thread " + to_string(t) + " record " + to_string(i),
+                                importances::MEDIUM);
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        manager.flush();
+        assert(sharded->shard_count() == static_cast<size_t>(threads));
+    }
+    shards = find_journal_shards(base);
+    assert(shards.size() == static_cast<size_t>(threads));
+    for (const string& shard : shards) {
+        ifstream in(shard);
+        int thread_id = -1;
+        int expected = 0;
+        while (getline(in, line)) {
+            size_t pos = line.find("thread ");
+            int t = stoi(line.substr(pos + 7));
+            if (thread_id == -1) thread_id = t;
+            assert(t == thread_id); // В сегменте записи одного источника
+            assert(stoi(line.substr(line.find("record ", pos) + 7)) == expected++);
+        }
+        assert(expected == per_thread);
+    }
+
+    // Повторное открытие: сегмент дописывается, номер продолжается,
+    // поэтому при слиянии записи прошлого запуска идут раньше
+    {
+        ShardedFileOutput output(base);
+        for (int i = 0; i < 10; ++i) {
+            output.write("rerun " + to_string(i));
+        }
+    }
+    {
+        ifstream in(base + ".shard-0");
+        uint64_t expected_sequence = 0;
+        int64_t last_ns = 0;
+        size_t reruns = 0;
+        while (getline(in, line)) {
+            size_t first = line.find(' ');
+            size_t second = line.find(' ', first + 1);
+            int64_t ns = stoll(line.substr(0, first));
+            assert(stoull(line.substr(first + 1, second - first - 1)) == expected_sequence++);
+            assert(ns >= last_ns);
+            last_ns = ns;
+            if (line.compare(second + 1, 6, "rerun ") == 0) {
+                assert(line.substr(second + 7) == to_string(reruns++));
+            } else {
+                assert(reruns == 0);
+            }
+        }
+        assert(reruns == 10 && expected_sequence == per_thread + 10);
+    }
+    stringstream rerun_merged;
+    assert(merge_journal_shards(find_journal_shards(base), rerun_merged) ==
+           static_cast<size_t>(threads * per_thread + 10));
+    size_t reruns = 0;
+    while (getline(rerun_merged, line)) {
+        if (line.compare(0, 6, "rerun ") == 0) {
+            assert(line == "rerun " + to_string(reruns++));
+        } else {
+            assert(reruns == 0);
+        }
+    }
+    assert(reruns == 10);
+    cleanup();
+
+    // Порядок слияния: время, затем номер, затем сегмент
+    {
+        ofstream(base + ".shard-0") << "100 0 a1\n300 1 a3\n300 2 a4\nno prefix\n";
+        ofstream(base + ".shard-1") << "200 0 b2\n300 0 b3\n400 1 b5\n";
+    }
+    stringstream ordered;
+    assert(merge_journal_shards(find_journal_shards(base), ordered) == 7);
+    assert(ordered.str() == "a1\nb2\nb3\na3\na4\nno prefix\nb5\n");
+    cleanup();
+}
+
+// Логгер, считающий вызовы sync
+class SyncCountingLogger : public ILogger {
+public:
+    importances get_default_importance() const override { return importances::MEDIUM; }
+    bool format(const string& message, importances importance, time_t, string_view, string& out) const override {
+        if (importance < importances::MEDIUM) return false;
+        out = message;
+        return true;
+    }
+    void write(const string&) override { writes++; }
+    void sync() override { syncs++; }
+
+    atomic<size_t> writes{0};
+    atomic<size_t> syncs{0};
+};
+
+// Test 16: Уведомления о завершении записи и асинхронный интерфейс
+void test_completion_durability() {
+    auto logger = make_unique<SyncCountingLogger>();
+    SyncCountingLogger* counting = logger.get();
+    LogManager manager(move(logger), 2);
+    manager.start();
+    
+    // QUEUED - сразу в вызывающем потоке
+    bool queued = false;
+    manager.log("queued", importances::HIGH, Durability::QUEUED, [&queued](bool ok) {
+        queued = ok;
+    });
+    assert(queued);
+    
+    // WRITTEN - после вывода; отфильтрованная запись тоже завершается
+    atomic<size_t> written{0};
+    atomic<size_t> synced{0};
+    const size_t count = 500;
+    for (size_t i = 0; i < count; ++i) {
+        manager.log("record " + to_string(i), i % 2 ? importances::HIGH : importances::LOW,
+                    Durability::WRITTEN, [&written](bool ok) { if (ok) written++; });
+    }
+    // SYNCED - записи сбрасываются группами, а не по одной
+    for (size_t i = 0; i < count; ++i) {
+        manager.log("synced " + to_string(i), importances::HIGH, Durability::SYNCED,
+                    [&synced](bool ok) { if (ok) synced++; });
+    }
+    manager.flush();
+    manager.stop();
+    assert(written == count);
+    assert(synced == count);
+    assert(counting->syncs >= 1 && counting->syncs < count);
+    assert(counting->writes == 1 + count / 2 + count);
+    
+    // После остановки запись не принимается, уведомление получает false
+    int after_stop = 0;
+    for (Durability durability : {Durability::QUEUED, Durability::WRITTEN, Durability::SYNCED}) {
+        manager.log("after stop", importances::HIGH, durability, [&after_stop](bool ok) {
+            assert(!ok);
+            after_stop++;
+        });
+    }
+    assert(after_stop == 3);
+    assert(counting->writes == 1 + count / 2 + count);
+    
+    // FileOutput::sync сбрасывает файл на диск
+    const string filename = "test_sync.log";
+    clear_test_file(filename);
+    {
+        LogManager file_manager(make_unique<FileLogger>(filename, importances::LOW));
+        file_manager.start();
+        atomic<bool> done{false};
+        file_manager.log("durable", importances::HIGH, Durability::SYNCED,
+                         [&done](bool ok) { done = ok; });
+        file_manager.flush();
+        while (!done) {
+            this_thread::yield();
+        }
+        ifstream file(filename);
+        string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        assert(content.find("[HIGH] durable") != string::npos);
+        file_manager.stop();
+    }
+    clear_test_file(filename);
+    
+#ifdef JOURNAL_HAS_COROUTINES
+    // Тысячи сопрограмм ждут записи, не занимая потоков
+    LogManager async_manager(make_unique<SyncCountingLogger>());
+    async_manager.start();
+    atomic<size_t> resumed{0};
+    auto writer = [&async_manager, &resumed](size_t id) -> DetachedTask {
+        bool ok = co_await log_async(async_manager, "async " + to_string(id), importances::HIGH);
+        ok = ok && co_await log_async(async_manager, "sync " + to_string(id), 
+                                      importances::HIGH, Durability::SYNCED);
+        if (ok) resumed++;
+    };
+    const size_t tasks = 2000;
+    for (size_t i = 0; i < tasks; ++i) {
+        writer(i);
+    }
+    while (resumed < tasks) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    async_manager.stop();
+    
+    // Ожидание записи в остановленный менеджер не зависает
+    atomic<int> stopped_result{-1};
+    auto late_writer = [&async_manager, &stopped_result]() -> DetachedTask {
+        bool ok = co_await log_async(async_manager, "late", importances::HIGH, Durability::SYNCED);
+        stopped_result = ok ? 1 : 0;
+    };
+    late_writer();
+    assert(stopped_result == 0);
+    auto late_queued = [&async_manager, &stopped_result]() -> DetachedTask {
+        bool ok = co_await log_async(async_manager, "late", importances::HIGH, Durability::QUEUED);
+        stopped_result = ok ? 1 : 0;
+    };
+    stopped_result = -1;
+    late_queued();
+    assert(stopped_result == 0);
+#endif
+}
+
+// Логгер, вывод которого стоит, пока не будет открыт
+class StalledLogger : public ILogger {
+public:
+    explicit StalledLogger(vector<string>& written) : m_written(written) {}
+    importances get_default_importance() const override { return importances::LOW; }
+    bool format(const string& message, importances, time_t, string_view fields,
+                string& out) const override {
+        out = message;
+        out.append(fields);
+        return true;
+    }
+    void write(const string& record) override {
+        unique_lock<mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_open; });
+        m_written.push_back(record);
+    }
+    void open() {
+        lock_guard<mutex> lock(m_mutex);
+        m_open = true;
+        m_condition.notify_all();
+    }
+
+private:
+    vector<string>& m_written;
+    mutex m_mutex;
+    condition_variable m_condition;
+    bool m_open = false;
+};
+
+// Test 17: Бюджет памяти: при стоящем выводе записи уходят на диск
+void test_spill_to_disk() {
+    const string spill_path = "test_spill.bin";
+    const size_t budget = 4096;
+    const int count = 5000;
+    vector<string> written;
+    {
+        auto logger = make_unique<StalledLogger>(written);
+        StalledLogger* stalled = logger.get();
+        LogManager manager(move(logger), 2);
+        manager.set_memory_budget(budget, spill_path);
+        manager.start();
+        
+        atomic<int> completed{0};
+        for (int i = 0; i < count; ++i) {
+            string message = "audit record " + to_string(i) + string(40, '.');
+            if (i % 100 == 0) {
+                manager.log(message, importances::HIGH, Durability::WRITTEN,
+                            [&completed](bool ok) { if (ok) completed++; });
+            } else if (i == count / 2) {
+                manager.log(message, importances::LOW, {{"index", i}});
+            } else {
+                manager.log(message, importances::LOW);
+            }
+            // Память очереди не растет сверх бюджета
+            assert(manager.queued_bytes() <= budget);
+        }
+        assert(manager.spilled() > static_cast<uint64_t>(count / 2));
+        assert(filesystem::file_size(spill_path) > 0);
+        
+        // Вывод догоняет: все записи выводятся, порядок полосы сохранен
+        stalled->open();
+        manager.flush();
+        assert(written.size() == static_cast<size_t>(count));
+        assert(completed == count / 100);
+        int previous = -1;
+        for (const string& record : written) {
+            if (record == "after") continue;
+            int index = stoi(record.substr(13));
+            if (index % 100 == 0) continue; // Полоса HIGH
+            assert(index > previous);
+            previous = index;
+            // Поля проходят через файл вытеснения вместе с записью
+            size_t field_count = 0;
+            for_each_log_field(record, [&](const ParsedLogField& field) {
+                assert(field.key == "index" && field.value == to_string(index));
+                field_count++;
+            });
+            assert(field_count == (index == count / 2 ? 1u : 0u));
+        }
+        assert(previous == count - 1);
+        assert(filesystem::file_size(spill_path) == 0); // Файл прочитан и усечен
+        
+        // После разгрузки новые записи снова идут прямо в очередь
+        uint64_t spilled = manager.spilled();
+        manager.log("after", importances::LOW);
+        manager.flush();
+        assert(manager.spilled() == spilled);
+        assert(written.back() == "after");
+        manager.stop();
+    }
+    // Файл вытеснения удаляется вместе с менеджером
+    assert(!filesystem::exists(spill_path));
+
+    // Ошибка записи в файл вытеснения (предел размера файла): запись
+    // отклоняется с false, уведомления остальных не сдвигаются
+    {
+        vector<string> output;
+        auto logger = make_unique<StalledLogger>(output);
+        StalledLogger* stalled = logger.get();
+        LogManager manager(move(logger), 2);
+        manager.set_memory_budget(256, spill_path);
+        manager.start();
+
+        struct rlimit saved;
+        getrlimit(RLIMIT_FSIZE, &saved);
+        auto saved_handler = signal(SIGXFSZ, SIG_IGN);
+        struct rlimit limited = saved;
+        limited.rlim_cur = 160 * 1024;
+        setrlimit(RLIMIT_FSIZE, &limited);
+        mutex results_mutex;
+        vector<int> succeeded;
+        int failed = 0;
+        auto log_record = [&](int i) {
+            string message = to_string(i) + " " + string(1000, '.');
+            manager.log(message, importances::LOW, Durability::WRITTEN,
+                        [&, i](bool ok) {
+                            lock_guard<mutex> lock(results_mutex);
+                            if (ok) {
+                                succeeded.push_back(i);
+                            } else {
+                                failed++;
+                            }
+                        });
+        };
+        const int total = 300;
+        for (int i = 0; i < total - 20; ++i) {
+            log_record(i);
+        }
+        // Записи после снятия предела получают свои уведомления
+        setrlimit(RLIMIT_FSIZE, &saved);
+        signal(SIGXFSZ, saved_handler);
+        for (int i = total - 20; i < total; ++i) {
+            log_record(i);
+        }
+        stalled->open();
+        manager.flush();
+        manager.stop();
+
+        assert(failed > 0);
+        assert(succeeded.size() + failed == static_cast<size_t>(total));
+        assert(output.size() == succeeded.size());
+        assert(succeeded.back() == total - 1);
+        for (size_t i = 0; i < output.size(); ++i) {
+            assert(stoi(output[i]) == succeeded[i]);
+        }
+    }
+
+    // Остановка во время вытеснения: каждая запись либо выведена с ok,
+    // либо отклонена с false, ни одна не пропадает без уведомления
+    for (int round = 0; round < 20; ++round) {
+        vector<string> output;
+        auto logger = make_unique<StalledLogger>(output);
+        logger->open();
+        LogManager manager(move(logger), 2);
+        manager.set_memory_budget(256, spill_path);
+        manager.start();
+
+        atomic<bool> stopped{false};
+        atomic<int> logged{0}, succeeded{0}, failed{0};
+        thread producer([&] {
+            // Часть записей приходит уже после остановки
+            for (int extra = 0; extra < 50; ) {
+                manager.log("spill race " + string(100, '.'), importances::LOW,
+                            Durability::WRITTEN,
+                            [&](bool ok) { ok ? succeeded++ : failed++; });
+                logged++;
+                if (stopped) extra++;
+            }
+        });
+        this_thread::sleep_for(chrono::milliseconds(2));
+        manager.stop();
+        stopped = true;
+        producer.join();
+        assert(succeeded + failed == logged);
+        assert(output.size() == static_cast<size_t>(succeeded));
+    }
+}
+
+// Test 18: Вывод через отображение в память: сегменты, усечение, дозапись
+void test_mapped_output() {
+    const string filename = "test_mapped.log";
+    clear_test_file(filename);
+    auto read_file = [&filename] {
+        ifstream file(filename, ios::binary);
+        return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    };
+    
+    // Маленькие сегменты: записи переходят через границы сегментов
+    string expected = "\xEF\xBB\xBF";
+    {
+        MappedFileOutput output(filename, 8192);
+        for (int i = 0; i < 2000; ++i) {
+            string record = "mapped record " + to_string(i);
+            output.write(record);
+            expected += record + "\n";
+        }
+        output.sync();
+        // Пока вывод открыт, файл выделен сегментами вперед
+        assert(filesystem::file_size(filename) > expected.size());
+    }
+    // При закрытии файл усечен до данных
+    assert(read_file() == expected);
+    
+    // Повторное открытие дописывает в конец, без второго BOM
+    {
+        MappedFileOutput output(filename, 8192);
+        output.write("reopened");
+        expected += "reopened\n";
+    }
+    assert(read_file() == expected);
+    
+    // После аварии в конце остается хвост из нулей - он отбрасывается
+    filesystem::resize_file(filename, expected.size() + 10000);
+    {
+        MappedFileOutput output(filename, 8192);
+        output.write("after crash");
+        expected += "after crash\n";
+    }
+    assert(read_file() == expected);
+    
+    // Через LogManager
+    {
+        LogManager manager(make_unique<FileLogger>(make_unique<MappedFileOutput>(filename),
+                                                   importances::LOW));
+        manager.start();
+        manager.log("via manager", importances::HIGH);
+        manager.stop();
+    }
+    string content = read_file();
+    assert(content.compare(0, expected.size(), expected) == 0);
+    assert(content.find("[HIGH] via manager\n") != string::npos);
+    assert(content.back() == '\n');
+    clear_test_file(filename);
+    
+    // Не удалось выделить следующий сегмент (предел размера файла):
+    // запись сообщает об ошибке, текущий сегмент остается рабочим
+    struct rlimit saved;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    auto saved_handler = signal(SIGXFSZ, SIG_IGN);
+    {
+        MappedFileOutput output(filename, 8192);
+        struct rlimit limited = saved;
+        limited.rlim_cur = 2 * 8192;
+        setrlimit(RLIMIT_FSIZE, &limited);
+        int failures = 0;
+        for (int i = 0; i < 1000; ++i) {
+            try {
+                output.write("limited record " + to_string(i));
+            } catch (const runtime_error&) {
+                ++failures;
+            }
+        }
+        assert(failures > 0);
+        output.sync(); // Текущий сегмент по-прежнему отображен
+        setrlimit(RLIMIT_FSIZE, &saved);
+        output.write("after limit");
+    }
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, saved_handler);
+    content = read_file();
+    assert(content.compare(0, 3, "\xEF\xBB\xBF") == 0);
+    assert(content.find("limited record 100\n") != string::npos);
+    assert(content.size() > 2 * 8192);
+    assert(content.compare(content.size() - 12, 12, "after limit\n") == 0);
+    clear_test_file(filename);
+}
+
+// Test 19: Ротация по размеру и времени, сжатие и хранение старых файлов
+void test_rotating_output() {
+    const string filename = "test_rotating.log";
+    auto cleanup = [&filename] {
+        filesystem::remove(filename);
+        for (const string& file : RotatingFileOutput::rotated_files(filename)) {
+            filesystem::remove(file);
+        }
+    };
+    auto read_file = [](const string& path) {
+        ifstream file(path, ios::binary);
+        return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    };
+    cleanup();
+    
+    // По размеру: старых файлов не больше retention, журнал существует всегда
+    RotationPolicy policy;
+    policy.max_bytes = 1000;
+    policy.retention = 3;
+    const int count = 400;
+    {
+        RotatingFileOutput output(filename, policy);
+        for (int i = 0; i < count; ++i) {
+            output.write("rotating record " + to_string(i) + string(20, '.'));
+            assert(filesystem::exists(filename));
+        }
+    } // Деструктор дожидается сжатия
+    vector<string> rotated = RotatingFileOutput::rotated_files(filename);
+    assert(rotated.size() == policy.retention);
+    string current = read_file(filename);
+    assert(current.compare(0, 3, "\xEF\xBB\xBF") == 0);
+    assert(current.size() < policy.max_bytes);
+    assert(current.find("rotating record " + to_string(count - 1)) != string::npos);
+    // Скрытый заранее созданный файл не остается
+    assert(!filesystem::exists(".test_rotating.log.next"));
+    
+#ifdef JOURNAL_HAVE_ZLIB
+    // Старые файлы сжаты и идут по порядку записей
+    int previous = -1;
+    for (const string& file : rotated) {
+        assert(file.size() > 3 && file.compare(file.size() - 3, 3, ".gz") == 0);
+        gzFile gz = gzopen(file.c_str(), "rb");
+        assert(gz != nullptr);
+        string content;
+        char buffer[4096];
+        int bytes;
+        while ((bytes = gzread(gz, buffer, sizeof(buffer))) > 0) {
+            content.append(buffer, bytes);
+        }
+        gzclose(gz);
+        assert(content.compare(0, 3, "\xEF\xBB\xBF") == 0);
+        istringstream lines(content.substr(3));
+        string line;
+        while (getline(lines, line)) {
+            int index = stoi(line.substr(16));
+            assert(previous == -1 || index == previous + 1);
+            previous = index;
+        }
+    }
+    assert(previous >= 0);
+    cleanup();
+
+    // Номер ротации начинается с 0 в каждом запуске: файлы прошлого
+    // запуска с тем же именем (сжатые и нет) не затираются
+    vector<string> earlier;
+    for (int offset = 0; offset < 3; ++offset) {
+        char stamp[32];
+        time_t moment = time(nullptr) + offset;
+        tm local;
+        localtime_r(&moment, &local);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+        earlier.push_back(filename + "." + stamp + "-0.gz");
+        earlier.push_back(filename + "." + stamp + "-1");
+    }
+    for (const string& file : earlier) {
+        ofstream(file) << "earlier run";
+    }
+    RotationPolicy keep_all = policy;
+    keep_all.retention = 0;
+    {
+        RotatingFileOutput output(filename, keep_all);
+        for (int i = 0; i < 100; ++i) {
+            output.write("rotating record " + to_string(i) + string(20, '.'));
+        }
+    }
+    for (const string& file : earlier) {
+        assert(read_file(file) == "earlier run");
+    }
+    assert(RotatingFileOutput::rotated_files(filename).size() > earlier.size());
+#endif
+    cleanup();
+
+    // По времени, без сжатия
+    RotationPolicy by_age;
+    by_age.max_age = chrono::seconds(1);
+    by_age.compress = false;
+    {
+        RotatingFileOutput output(filename, by_age);
+        output.write("first");
+        this_thread::sleep_for(chrono::milliseconds(1100));
+        output.write("second"); // Файл старше max_age: ротация после записи
+        output.write("third");
+    }
+    rotated = RotatingFileOutput::rotated_files(filename);
+    assert(rotated.size() == 1);
+    assert(read_file(rotated[0]) == "\xEF\xBB\xBF" "first\nsecond\n");
+    assert(read_file(filename) == "\xEF\xBB\xBF" "third\n");
+    cleanup();
+}
+
 int main() {
     try {
         cout << "Running journal library tests...\n";
@@ -178,6 +1417,18 @@ int main() {
         test_thread_safety();
         test_empty_message();    
         test_empty_priority();   
+        test_structured_fields();
+        test_batch_ingest();
+        test_format_workers_order();
+        test_steady_state_allocations();
+        test_shm_ring();
+        test_routing_rules();
+        test_priority_lanes();
+        test_sharded_output();
+        test_completion_durability();
+        test_spill_to_disk();
+        test_mapped_output();
+        test_rotating_output();
         
         cout << "All tests passed successfully!\n";
         return 0;
@@ -1,5 +1,9 @@
-#include "journal_lib.hpp"
+#include "stats_query.hpp"
+#include "rollup_store.hpp"
+#include "log_tail.hpp"
+#include "record_scan.hpp"
 #include <cassert>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <vector>
@@ -13,6 +17,11 @@
 #include <unistd.h>
 #include <atomic>
 #include <memory>
+#include <cmath>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <sys/wait.h>
 
 using namespace std;
 
@@ -191,6 +200,500 @@ void test_time_based_stats() {
     this_thread::sleep_for(chrono::milliseconds(500));
 }
 
+// Тест 6: Агрегация структурированных полей без разбора текста
+void test_field_aggregation() {
+    MessageStats stats;
+    time_t now = time(nullptr);
+    
+    string first = "[2023-01-01 12:00:00] [LOW] Request";
+    append_log_field(first, LogField("status", "ok"));
+    append_log_field(first, LogField("bytes", 100));
+    string second = "[2023-01-01 12:00:01] [HIGH] Request";
+    append_log_field(second, LogField("status", "ok"));
+    append_log_field(second, LogField("bytes", 250));
+    append_log_field(second, LogField("latency", 0.5));
+    
+    update_stats(stats, first, now);
+    update_stats(stats, second, now);
+    
+    assert(stats.total == 2);
+    assert(stats.by_importance.at(importances::LOW) == 1);
+    assert(stats.by_importance.at(importances::HIGH) == 1);
+    assert(stats.fields.at("status=ok").count == 2);
+    assert(stats.fields.at("bytes").count == 2);
+    assert(stats.fields.at("bytes").sum == 350.0);
+    assert(stats.fields.at("latency").sum == 0.5);
+    
+    ostringstream out;
+    print_stats(stats, out);
+    assert(out.str().find("bytes: count 2, sum 350") != string::npos);
+}
+
+// Тест 7: Частые шаблоны сообщений при ограниченной памяти
+void test_top_templates() {
+    string normalized;
+    normalize_template("[2023-01-01 12:00:00] [LOW] User 42 logged in", normalized);
+    assert(normalized == "User # logged in");
+
+    TopK top(8);
+    // Много редких уникальных сообщений и два частых
+    for (int i = 0; i < 1000; ++i) {
+        top.add("unique " + to_string(i) + "x");
+        if (i % 2 == 0) top.add("frequent A");
+        if (i % 4 == 0) top.add("frequent B");
+    }
+    
+    vector<TopK::Entry> result = top.top(2);
+    assert(result.size() == 2);
+    assert(result[0].key == "frequent A");
+    assert(result[1].key == "frequent B");
+    assert(result[0].count >= 500);
+    assert(top.top(100).size() == 8); // Память ограничена capacity
+}
+
+// Тест 8: Оценка числа различных элементов и объединение шардов
+void test_distinct_counting() {
+    HyperLogLog total;
+    HyperLogLog shard_a;
+    HyperLogLog shard_b;
+    for (int i = 0; i < 50000; ++i) {
+        string item = "message " + to_string(i);
+        total.add(item);
+        total.add(item); // Повторы не влияют на оценку
+        (i % 2 ? shard_a : shard_b).add(item);
+    }
+    
+    double estimate = total.estimate();
+    assert(estimate > 50000 * 0.95 && estimate < 50000 * 1.05);
+    
+    shard_a.merge(shard_b);
+    assert(shard_a.estimate() == estimate); // Объединение эквивалентно общему подсчету
+    
+    HyperLogLog small;
+    for (int i = 0; i < 10; ++i) small.add("source " + to_string(i));
+    assert(llround(small.estimate()) == 10);
+    
+    // Источники учитываются в MessageStats
+    MessageStats stats;
+    time_t now = time(nullptr);
+    update_stats(stats, "[2023-01-01 12:00:00] [LOW] A 1", now, "10.0.0.1");
+    update_stats(stats, "[2023-01-01 12:00:00] [LOW] A 2", now, "10.0.0.2");
+    update_stats(stats, "[2023-01-01 12:00:00] [LOW] B", now, "10.0.0.1");
+    assert(llround(stats.distinct_templates.estimate()) == 2);
+    assert(llround(stats.distinct_sources.estimate()) == 2);
+    assert(llround(stats.window_sources.estimate()) == 2);
+}
+
+// Тест 9: Снимок статистики через порт запросов
+void test_snapshot_query() {
+    // Читатели всегда видят согласованный снимок, пока писатель обновляет его
+    Seqlock<StatsSnapshot> published;
+    atomic<bool> done(false);
+    thread writer([&published, &done]() {
+        for (uint64_t i = 1; i <= 200000; ++i) {
+            StatsSnapshot snapshot;
+            snapshot.total = i;
+            snapshot.low = i;
+            snapshot.max_len = i * 2;
+            published.store(snapshot);
+        }
+        done = true;
+    });
+    while (!done) {
+        StatsSnapshot snapshot = published.load();
+        assert(snapshot.low == snapshot.total);
+        assert(snapshot.max_len == snapshot.total * 2);
+    }
+    writer.join();
+    
+    // Снимок отдается в JSON по запросу
+    MessageStats stats;
+    string message = "[2023-01-01 12:00:00] [MEDIUM] Query \"me\"";
+    append_log_field(message, LogField("status", "ok"));
+    append_log_field(message, LogField("bytes", 100));
+    for (int i = 0; i < 3; ++i) {
+        update_stats(stats, message, time(nullptr), "10.0.0.1:5000");
+    }
+    
+    // В снимок попадают только самые частые поля; длинный ключ обрезается
+    // по границе символа UTF-8
+    string long_key;
+    for (int i = 0; i < 100; ++i) {
+        long_key += "\xD1\x8F"; // "я"
+    }
+    for (size_t i = 0; i < SNAPSHOT_FIELDS + 4; ++i) {
+        string rare = "[2023-01-01 12:00:00] [LOW] Rare";
+        append_log_field(rare, LogField(i < 2 ? long_key : "rare" + to_string(i), 1));
+        update_stats(stats, rare, time(nullptr));
+    }
+    StatsSnapshot snapshot = make_snapshot(stats, time(nullptr));
+    assert(snapshot.template_count == 2);
+    assert(snapshot.templates[0].count == SNAPSHOT_FIELDS + 4);
+    assert(snapshot.field_count == SNAPSHOT_FIELDS);
+    assert(string(snapshot.fields[0].key) == "bytes");
+    assert(snapshot.fields[0].sum == 300.0);
+    assert(string(snapshot.fields[1].key) == "status=ok");
+    string key = snapshot.fields[2].key;
+    assert(snapshot.fields[2].count == 2);
+    assert(key.size() == SNAPSHOT_TEXT_LEN - 2);
+    assert(long_key.compare(0, key.size(), key) == 0);
+    assert(snapshot.client_count == 1 && snapshot.clients_active == 1);
+    assert(string(snapshot.clients[0].source) == "10.0.0.1:5000");
+    assert(snapshot.clients[0].medium == 3);
+    published.store(snapshot);
+    
+    int port = get_free_port();
+    SnapshotServer server(port, published);
+    
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in serv_addr{};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr);
+    assert(connect(sock, (sockaddr*)&serv_addr, sizeof(serv_addr)) == 0);
+    
+    string response;
+    char buf[512];
+    ssize_t n;
+    while ((n = recv(sock, buf, sizeof(buf), 0)) > 0) {
+        response.append(buf, n);
+    }
+    close(sock);
+    
+    assert(response.find("\"total\":" + to_string(SNAPSHOT_FIELDS + 7)) != string::npos);
+    assert(response.find("\"MEDIUM\":3") != string::npos);
+    assert(response.find("Query \\\"me\\\"\",\"count\":3") != string::npos);
+    assert(response.find("{\"key\":\"bytes\",\"count\":3,\"sum\":300}") != string::npos);
+    assert(response.find("{\"key\":\"status=ok\",\"count\":3}") != string::npos);
+    assert(response.find("\"source\":\"10.0.0.1:5000\",\"total\":3") != string::npos);
+    assert(response.back() == '\n');
+}
+
+// Тест 10: Воспроизведение журнала в коллектор по нескольким соединениям
+void test_journal_replay() {
+    const string journal = "test_replay_journal.log";
+    {
+        ofstream file(journal);
+        for (int i = 0; i < 1000; ++i) {
+            file << "[2023-01-01 12:00:00] [" << (i % 2 ? "LOW" : "HIGH") 
+                 << "] Replay message " << i << "\n";
+        }
+    }
+    
+    int port = get_free_port();
+    int query_port = get_free_port();
+    thread collector_thread([port, query_port]() {
+        quiet_system((string("./stats_collector ") + to_string(port) + " 100000 1 --query-port " +
+                      to_string(query_port)).c_str());
+    });
+    this_thread::sleep_for(chrono::milliseconds(500));
+    
+    // Еще одно соединение держит коллектор запущенным, пока читаем снимок
+    int keepalive = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in serv_addr{};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr);
+    assert(connect(keepalive, (sockaddr*)&serv_addr, sizeof(serv_addr)) == 0);
+    
+    int ret = quiet_system((string("./journal_replay ") + journal + " 127.0.0.1 " + 
+                            to_string(port) + " --connections 4 --loops 2").c_str());
+    assert(WIFEXITED(ret) && WEXITSTATUS(ret) == 0);
+    
+    // Коллектор публикует снимок не реже раза в секунду
+    string response;
+    for (int attempt = 0; attempt < 20; ++attempt) {
+        this_thread::sleep_for(chrono::milliseconds(200));
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in query_addr = serv_addr;
+        query_addr.sin_port = htons(query_port);
+        assert(connect(sock, (sockaddr*)&query_addr, sizeof(query_addr)) == 0);
+        response.clear();
+        char buf[512];
+        ssize_t n;
+        while ((n = recv(sock, buf, sizeof(buf), 0)) > 0) {
+            response.append(buf, n);
+        }
+        close(sock);
+        if (response.find("\"total\":2000,") != string::npos) break;
+    }
+    assert(response.find("\"total\":2000,") != string::npos);
+    assert(response.find("\"LOW\":1000") != string::npos);
+    
+    close(keepalive);
+    collector_thread.join();
+    remove(journal.c_str());
+}
+
+// Тест 11: Поминутные агрегаты в столбцовом файле
+void test_rollup_storage() {
+    const string rollup_file = "test_rollup.bin";
+    remove(rollup_file.c_str());
+    
+    const time_t start = 1700000000 - 1700000000 % 60;
+    const int minutes = 30 * 24 * 60; // Месяц истории
+    {
+        RollupWriter writer(rollup_file);
+        for (int m = 0; m < minutes; ++m) {
+            time_t t = start + m * 60;
+            writer.add(t, importances::LOW, 40 + m % 7);
+            writer.add(t + 10, importances::HIGH, 60);
+            if (m % 10 == 0) writer.add(t + 20, importances::MEDIUM, 100);
+        }
+    }
+    // Перезапуск коллектора в той же минуте: строки объединяются при запросе
+    {
+        RollupWriter writer(rollup_file);
+        writer.add(start + (minutes - 1) * 60 + 30, importances::HIGH, 10);
+    }
+    
+    // Месяц поминутной истории занимает меньше мегабайта
+    assert(filesystem::file_size(rollup_file) < 512 * 1024);
+    
+    // Запрос часа в середине интервала (с начала часа)
+    const int64_t from = (start / 60 + 1000) / 60 * 60;
+    const int offset = static_cast<int>(from - start / 60);
+    vector<RollupRow> rows = query_rollups(rollup_file, from, from + 59);
+    assert(rows.size() == 60);
+    assert(rows.front().minute == from);
+    assert(rows[0].low == 1 && rows[0].high == 1);
+    assert(rows[0].medium == (offset % 10 == 0 ? 1u : 0u));
+    assert(rows[0].min_len == 40u + offset % 7);
+    assert(rows[0].max_len == (offset % 10 == 0 ? 100u : 60u));
+    
+    // Последняя минута объединена из двух запусков
+    const int64_t last = start / 60 + minutes - 1;
+    rows = query_rollups(rollup_file, last, last);
+    assert(rows.size() == 1);
+    assert(rows[0].high == 2 && rows[0].min_len == 10);
+    
+    ostringstream out;
+    print_rollups(query_rollups(rollup_file, from, from + 59), 60, out);
+    assert(out.str().find("60      6       60") != string::npos);
+    
+    // Блок, оборванный в конце файла (данных меньше заявленного),
+    // пропускается до выделения памяти под заявленный размер
+    const size_t intact_size = filesystem::file_size(rollup_file);
+    {
+        ofstream file(rollup_file, ios::app | ios::binary);
+        file.write("JRLB", 4);
+        file.write("\x3C\x01\x00\xA0\x1F", 5); // 60 строк, 4000 байт данных
+        file.write("\x00\x00", 2);
+    }
+    rows = query_rollups(rollup_file, last, last);
+    assert(rows.size() == 1 && rows[0].high == 2);
+    
+    // Невозможное число строк - блок поврежден
+    filesystem::resize_file(rollup_file, intact_size);
+    {
+        ofstream file(rollup_file, ios::app | ios::binary);
+        file.write("JRLB", 4);
+        file.write("\xFF\xFF\xFF\xFF\x0F\x01\x00\x01\x00", 9);
+    }
+    bool corrupted = false;
+    try {
+        query_rollups(rollup_file, last, last);
+    } catch (const runtime_error& e) {
+        corrupted = string(e.what()).find("Corrupted") != string::npos;
+    }
+    assert(corrupted);
+    
+    remove(rollup_file.c_str());
+}
+
+// Тест 12: Статистика по клиентам с ограниченной памятью
+void test_client_stats() {
+    ClientTable table(3, 60);
+    const time_t start = 1700000000 - 1700000000 % CLIENT_RATE_INTERVAL;
+    for (int i = 0; i < 20; ++i) {
+        table.update("10.0.0.1:5000", importances::HIGH, 100, start + i);
+    }
+    table.update("10.0.0.2:5000", importances::LOW, 10, start + 20);
+    table.update("10.0.0.3:5000", importances::MEDIUM, 10, start + 20);
+    
+    vector<const ClientStats*> top = table.top(10);
+    assert(top.size() == 3);
+    assert(top[0]->source == "10.0.0.1:5000");
+    assert(top[0]->total == 20 && top[0]->by_importance[2] == 20);
+    assert(top[0]->bytes == 2000);
+    // Прошлый интервал: 10 сообщений за CLIENT_RATE_INTERVAL секунд
+    assert(top[0]->rate(start + 19) == 10.0 / CLIENT_RATE_INTERVAL);
+    
+    // Переполнение: вытесняется клиент, дольше всех не писавший (10.0.0.1)
+    table.update("10.0.0.4:5000", importances::LOW, 10, start + 21);
+    assert(table.size() == 3);
+    assert(table.evicted() == 1 && table.evicted_messages() == 20);
+    top = table.top(10);
+    assert(none_of(top.begin(), top.end(),
+                   [](const ClientStats* c) { return c->source == "10.0.0.1:5000"; }));
+    
+    // Простой дольше таймаута: остаются только писавшие недавно
+    table.update("10.0.0.5:5000", importances::LOW, 10, start + 100);
+    assert(table.size() == 1);
+    assert(table.evicted() == 4);
+    
+    // Тысячи коротких клиентов не раздувают таблицу
+    MessageStats stats;
+    for (int i = 0; i < 5000; ++i) {
+        update_stats(stats, "[2023-01-01 12:00:00] [LOW] hello", start, 
+                     "10.1." + to_string(i / 256) + "." + to_string(i % 256) + ":1");
+    }
+    for (int i = 0; i < 50; ++i) {
+        update_stats(stats, "[2023-01-01 12:00:00] [HIGH] flood", start, "10.9.9.9:7");
+    }
+    assert(stats.clients.size() == MAX_CLIENTS);
+    ostringstream out;
+    print_stats(stats, out);
+    string report = out.str();
+    assert(report.find("Clients (" + to_string(MAX_CLIENTS) + " active") != string::npos);
+    // Самый активный клиент выводится первым
+    size_t clients_pos = report.find("Clients (");
+    size_t first_line = report.find('\n', clients_pos) + 1;
+    assert(report.compare(first_line, 15, "  10.9.9.9:7: 5") == 0);
+}
+
+// Тест 13: Слежение за файлом журнала: дописывание, ротация, усечение
+void test_log_tail() {
+    const string dir = "test_tail_dir";
+    filesystem::remove_all(dir);
+    filesystem::create_directory(dir);
+    const string path = dir + "/app.log";
+    
+    // Содержимое до запуска пропускается (чтение с конца)
+    ofstream(path) << "old record\n";
+    
+    LogTailer tailer({path});
+    vector<string> records;
+    auto collect = [&tailer, &records](size_t expected) {
+        for (int i = 0; i < 50 && records.size() < expected; ++i) {
+            if (tailer.wait(100)) {
+                tailer.process([&records](string_view record, string_view source) {
+                    assert(source == "test_tail_dir/app.log");
+                    records.emplace_back(record);
+                });
+            }
+        }
+    };
+    
+    {
+        ofstream out(path, ios::app);
+        out << "first\nsec" << flush;
+        collect(1);
+        out << "ond\nthird\n" << flush; // Запись, пришедшая частями
+    }
+    collect(3);
+    assert((records == vector<string>{"first", "second", "third"}));
+    
+    // Ротация переименованием: старый файл дочитывается, новый читается с начала
+    records.clear();
+    {
+        ofstream out(path, ios::app);
+        out << "before rotation\n";
+    }
+    filesystem::rename(path, path + ".1");
+    ofstream(path) << "after rotation\n";
+    collect(2);
+    assert((records == vector<string>{"before rotation", "after rotation"}));
+    
+    // Усечение (copytruncate): чтение продолжается с начала файла
+    records.clear();
+    ofstream(path, ios::trunc) << "x\n";
+    collect(1);
+    assert((records == vector<string>{"x"}));
+
+    // Удаление открытого файла (IN_DELETE_SELF не приходит, пока файл
+    // открыт): файл дочитывается и закрывается, созданный заново
+    // читается с начала
+    auto holds_deleted = [] {
+        for (const auto& entry : filesystem::directory_iterator("/proc/self/fd")) {
+            error_code error;
+            string target = filesystem::read_symlink(entry.path(), error).string();
+            if (target.find("app.log (deleted)") != string::npos) return true;
+        }
+        return false;
+    };
+    records.clear();
+    {
+        ofstream out(path, ios::app);
+        out << "before delete\n";
+    }
+    filesystem::remove(path);
+    collect(1);
+    for (int i = 0; i < 10 && tailer.wait(100); ++i) {
+        tailer.process([&records](string_view record, string_view) {
+            records.emplace_back(record);
+        });
+    }
+    assert((records == vector<string>{"before delete"}));
+    assert(!holds_deleted());
+    ofstream(path) << "recreated\n";
+    collect(2);
+    assert((records == vector<string>{"before delete", "recreated"}));
+    
+    filesystem::remove_all(dir);
+}
+
+// Тест 14: Векторный поиск границ и тегов совпадает со скалярным
+void test_record_scan() {
+    // Перевод строки в каждой позиции и на каждом смещении начала,
+    // чтобы проверить хвосты и невыровненные блоки всех реализаций
+    string data(300, 'x');
+    for (size_t length = 0; length < 200; ++length) {
+        for (size_t offset = 0; offset < 40; offset += 7) {
+            const char* begin = data.data() + offset;
+            const char* end = begin + length;
+            for (size_t at = 0; at <= length; ++at) {
+                if (at < length) data[offset + at] = '\n';
+                for (ScanImpl impl : {ScanImpl::SCALAR, ScanImpl::SSE2, ScanImpl::AVX2}) {
+                    assert(find_byte(impl, begin, end, '\n') == begin + at);
+                }
+                if (at < length) data[offset + at] = 'x';
+            }
+        }
+    }
+    
+    // Уровень по тегу с прежними правилами
+    assert(scan_importance("[2023-01-01 12:00:00] [LOW] text") == importances::LOW);
+    assert(scan_importance("[2023-01-01 12:00:00] [MEDIUM] text") == importances::MEDIUM);
+    assert(scan_importance("[2023-01-01 12:00:00] [HIGH] text") == importances::HIGH);
+    assert(scan_importance("[2023-01-01 12:00:00] [MEDIUM] says [LOW]") == importances::LOW);
+    assert(scan_importance("no tag [ [MED [LOW") == importances::HIGH);
+    assert(scan_importance("") == importances::HIGH);
+    
+    // Буфер приема: записи, разрезанные на части, и общий буфер для двух источников
+    const string stream_a = "first\nsec" "ond\n\nthird";
+    const string stream_b = "other\n";
+    RecordBuffer buffer(MAX_RECORD_SIZE * 2);
+    vector<string> records;
+    auto collect = [&records](string_view record) { records.emplace_back(record); };
+    string pending_a, pending_b;
+    for (size_t i = 0; i < stream_a.size(); i += 4) {
+        buffer.load_pending(pending_a);
+        string chunk = stream_a.substr(i, 4);
+        memcpy(buffer.space(), chunk.data(), chunk.size());
+        buffer.commit(chunk.size(), collect);
+        buffer.save_pending(pending_a);
+        
+        buffer.load_pending(pending_b);
+        if (i == 4) {
+            memcpy(buffer.space(), stream_b.data(), stream_b.size());
+            buffer.commit(stream_b.size(), collect);
+        }
+        buffer.save_pending(pending_b);
+    }
+    buffer.load_pending(pending_a);
+    buffer.finish(collect);
+    assert((records == vector<string>{"first", "other", "second", "third"}));
+    
+    // Запись без перевода строки длиннее MAX_RECORD_SIZE передается целиком
+    records.clear();
+    string huge(MAX_RECORD_SIZE + 10, 'y');
+    memcpy(buffer.space(), huge.data(), huge.size());
+    buffer.commit(huge.size(), collect);
+    assert(records.size() == 1 && records[0].size() == huge.size());
+    assert(buffer.pending() == 0);
+}
+
 int main() {
     cout << "Running stats_collector tests...\n";
     
@@ -199,6 +702,15 @@ int main() {
     test_importance_stats();
     test_message_length_stats();
     test_time_based_stats();
+    test_field_aggregation();
+    test_top_templates();
+    test_distinct_counting();
+    test_snapshot_query();
+    test_journal_replay();
+    test_rollup_storage();
+    test_client_stats();
+    test_log_tail();
+    test_record_scan();
     
     cout << "All stats_collector tests completed!\n";
     return 0;